@@ -3,6 +3,7 @@
 
 #include "rtweekend.h"
 #include "hittable.h"
+#include "material.h"
 
 /**
  * @brief 垂直于 z 轴的 xy 平面
@@ -23,6 +24,17 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        auto t = (z - r.origin().z()) / r.direction().z();
+        if (t < t_min || t > t_max)
+            return false;
+
+        auto x = r.origin().x() + t * r.direction().x();
+        auto y = r.origin().y() + t * r.direction().y();
+        return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         // The bounding box must have non-zero width in each dimension, so pad the Z
@@ -33,15 +45,16 @@ public:
 
     virtual double pdf_value(const point3 &origin, const vec3 &direction) const override
     {
-        hit_record rec;
-        if (!hit(ray(origin, direction), 0.001, infinity, rec))
+        if (!any_hit_query(*this, ray(origin, direction), 0.001, infinity))
         {
             return 0;
         }
 
+        // 平面的法线为 z 轴，交点的 t 可以直接求出
+        auto t = (z - origin.z()) / direction.z();
         auto area = (x1 - x0) * (y1 - y0);
-        auto distance_squared = rec.t * rec.t * direction.length_squared();
-        auto cosine = fabs(dot(direction, rec.normal) / direction.length());
+        auto distance_squared = t * t * direction.length_squared();
+        auto cosine = fabs(direction.z() / direction.length());
 
         return distance_squared / (cosine * area);
     }
@@ -51,6 +64,19 @@ public:
         auto random_point = point3(random_double(x0, x1), random_double(y0, y1), z);
         return random_point - origin;
     }
+
+    virtual double power() const override
+    {
+        return luminance(mat->average_emission()) * (x1 - x0) * (y1 - y0);
+    }
+
+    virtual void emission_cone(vec3 &w, double &cos_theta_o, bool &two_sided) const override
+    {
+        // 光源列表中的矩形不知道场景中是否被 flip_face 翻转，按两面发光处理
+        w = vec3(0, 0, 1);
+        cos_theta_o = 1;
+        two_sided = true;
+    }
 };
 
 class xz_rect : public hittable
@@ -63,6 +89,17 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        auto t = (y - r.origin().y()) / r.direction().y();
+        if (t < t_min || t > t_max)
+            return false;
+
+        auto x = r.origin().x() + t * r.direction().x();
+        auto z = r.origin().z() + t * r.direction().z();
+        return x >= x0 && x <= x1 && z >= z0 && z <= z1;
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         // The bounding box must have non-zero width in each dimension, so pad the Y
@@ -73,15 +110,16 @@ public:
 
     virtual double pdf_value(const point3 &origin, const vec3 &direction) const override
     {
-        hit_record rec;
-        if (!hit(ray(origin, direction), 0.001, infinity, rec))
+        if (!any_hit_query(*this, ray(origin, direction), 0.001, infinity))
         {
             return 0;
         }
 
+        // 平面的法线为 y 轴，交点的 t 可以直接求出
+        auto t = (y - origin.y()) / direction.y();
         auto area = (x1 - x0) * (z1 - z0);
-        auto distance_squared = rec.t * rec.t * direction.length_squared();
-        auto cosine = fabs(dot(direction, rec.normal) / direction.length());
+        auto distance_squared = t * t * direction.length_squared();
+        auto cosine = fabs(direction.y() / direction.length());
 
         return distance_squared / (cosine * area);
     }
@@ -92,6 +130,18 @@ public:
         return random_point - origin;
     }
 
+    virtual double power() const override
+    {
+        return luminance(mat->average_emission()) * (x1 - x0) * (z1 - z0);
+    }
+
+    virtual void emission_cone(vec3 &w, double &cos_theta_o, bool &two_sided) const override
+    {
+        w = vec3(0, 1, 0);
+        cos_theta_o = 1;
+        two_sided = true;
+    }
+
 public:
     shared_ptr<material> mat;
     double x0, x1, z0, z1, y;
@@ -108,6 +158,17 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        auto t = (k - r.origin().x()) / r.direction().x();
+        if (t < t_min || t > t_max)
+            return false;
+
+        auto y = r.origin().y() + t * r.direction().y();
+        auto z = r.origin().z() + t * r.direction().z();
+        return y >= y0 && y <= y1 && z >= z0 && z <= z1;
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         // The bounding box must have non-zero width in each dimension, so pad the X
@@ -116,6 +177,18 @@ public:
         return true;
     }
 
+    virtual double power() const override
+    {
+        return luminance(mp->average_emission()) * (y1 - y0) * (z1 - z0);
+    }
+
+    virtual void emission_cone(vec3 &w, double &cos_theta_o, bool &two_sided) const override
+    {
+        w = vec3(1, 0, 0);
+        cos_theta_o = 1;
+        two_sided = true;
+    }
+
 public:
     shared_ptr<material> mp;
     double y0, y1, z0, z1, k;
@@ -137,7 +210,7 @@ bool xy_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) con
     rec.t = t;
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat = mat;
+    rec.mat = mat.get();
     rec.p = r.at(t);
 
     return true;
@@ -157,7 +230,7 @@ bool xz_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) con
     rec.t = t;
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat = mat;
+    rec.mat = mat.get();
     rec.p = r.at(t);
     return true;
 }
@@ -176,7 +249,7 @@ bool yz_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) con
     rec.t = t;
     auto outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat = mp;
+    rec.mat = mp.get();
     rec.p = r.at(t);
     return true;
 }
@@ -4,12 +4,15 @@
 #include "rtweekend.h"
 
 /**
- * @brief 轴对齐包围盒
+ * @brief 轴对齐包围盒；T 为标量类型，项目中通过 aabb 使用
  */
-class aabb
+template <typename T>
+class aabb_t
 {
 public:
-    aabb() {}
+    using point = vec3_t<T>;
+
+    aabb_t() {}
 
     /**
      * @brief 生成一个新的包围盒
@@ -17,12 +20,12 @@ public:
      * @param a 包围盒最小端
      * @param b 包围盒最大端
      */
-    aabb(const point3 &a, const point3 &b) : minimum(a), maximum(b)
+    aabb_t(const point &a, const point &b) : minimum(a), maximum(b)
     {
     }
 
-    point3 min() const { return minimum; }
-    point3 max() const { return maximum; }
+    point min() const { return minimum; }
+    point max() const { return maximum; }
 
     /**
      * @brief 判断射线在指定时间范围内是否与包围盒相交
@@ -31,7 +34,7 @@ public:
      * @param t_min 时间范围下限
      * @param t_max 时间范围上限
      */
-    inline bool hit(const ray &r, double t_min, double t_max) const
+    inline bool hit(const ray_t<T> &r, double t_min, double t_max) const
     {
         for (int a = 0; a < 3; a++)
         {
@@ -52,25 +55,52 @@ public:
         return true;
     }
 
-public:
-    point3 minimum;
-    point3 maximum;
-};
+    /**
+     * @brief 包围盒的表面积，用于表面积启发式（SAH）估计射线击中包围盒的概率
+     */
+    T surface_area() const
+    {
+        auto d = maximum - minimum;
+        return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
 
-/**
- * @brief 将两个包围盒合并成一个更大的包围盒
- */
-aabb surrounding_box(aabb box0, aabb box1)
-{
-    point3 small(fmin(box0.min().x(), box1.min().x()),
-                 fmin(box0.min().y(), box1.min().y()),
-                 fmin(box0.min().z(), box1.min().z()));
+    point centroid() const
+    {
+        return 0.5 * (minimum + maximum);
+    }
+
+    /**
+     * @brief 返回包围盒最长的轴
+     */
+    int longest_axis() const
+    {
+        auto d = maximum - minimum;
+        if (d.x() > d.y() && d.x() > d.z())
+            return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
 
-    point3 big(fmax(box0.max().x(), box1.max().x()),
-               fmax(box0.max().y(), box1.max().y()),
-               fmax(box0.max().z(), box1.max().z()));
+    /**
+     * @brief 将两个包围盒合并成一个更大的包围盒
+     */
+    friend aabb_t surrounding_box(const aabb_t &box0, const aabb_t &box1)
+    {
+        point small(fmin(box0.min().x(), box1.min().x()),
+                    fmin(box0.min().y(), box1.min().y()),
+                    fmin(box0.min().z(), box1.min().z()));
+
+        point big(fmax(box0.max().x(), box1.max().x()),
+                  fmax(box0.max().y(), box1.max().y()),
+                  fmax(box0.max().z(), box1.max().z()));
+
+        return aabb_t(small, big);
+    }
+
+public:
+    point minimum;
+    point maximum;
+};
 
-    return aabb(small, big);
-}
+using aabb = aabb_t<real>;
 
 #endif
@@ -0,0 +1,765 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "scene_generator.h"
+#include "renderer.h"
+#include "color.h"
+#include "image_io.h"
+
+// 基准测试程序；与主程序一样通过 ../../res/ 读取模型和贴图，需要在构建目录下两级的子目录中运行
+//
+// 用法：benchmark [测试名称|all] [图像宽度] [每像素采样数]
+
+// 统计整个程序中 operator new 的调用次数；数组形式也一并替换，使每一种 new 都与对应的 delete 配对
+static std::atomic<uint64_t> allocation_count{0};
+
+void *operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+// operator delete 被内联后，GCC 只看到 free 接收了 operator new 返回的指针，并不知道上面的 operator new 使用的是 malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+struct benchmark_config
+{
+    int image_width = 120;
+    int samples_per_pixel = 32;
+};
+
+/**
+ * @brief 按给定的分辨率和采样数渲染场景，返回平均到每个采样的 frame buffer
+ */
+std::vector<color> render_scene(renderer &r, const shared_ptr<scene_generator> &scene, int image_width, int samples_per_pixel)
+{
+    scene->image_width = image_width;
+    scene->image_height = static_cast<int>(image_width / scene->aspect_ratio);
+    scene->samples_per_pixel = samples_per_pixel;
+
+    r.options.show_progress = false;
+    r.render(scene, scene->lights());
+
+    auto frame_buffer = r.get_frame_buffer();
+    for (auto &c : frame_buffer)
+    {
+        // 与 write_color 相同，将 NaN 视为 0
+        for (int i = 0; i < 3; i++)
+            c[i] = c[i] != c[i] ? 0.0 : c[i] / samples_per_pixel;
+    }
+
+    return frame_buffer;
+}
+
+/**
+ * @brief 两幅图像之间的均方误差
+ */
+double mean_squared_error(const std::vector<color> &a, const std::vector<color> &b)
+{
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        auto d = a[i] - b[i];
+        sum += d.length_squared() / 3;
+    }
+
+    return sum / a.size();
+}
+
+/**
+ * @brief 比较各个积分器的速度和噪声；噪声以相同采样数下相对于高采样参考图的均方误差衡量，
+ * 均方误差与采样数成反比，因此 equal-noise spp 为达到递归积分器相同噪声所需的采样数的估计
+ *
+ * the_next_week_final_scene 中的物体是随机放置的，参考图和被测图像依赖 build_world 每次生成相同的场景，
+ * 否则均方误差中主要是场景之间的差异
+ */
+void benchmark_integrator(const benchmark_config &config)
+{
+    const std::pair<const char *, shared_ptr<scene_generator>> scenes[] = {
+        {"cornell_box", make_shared<cornell_box>()},
+        {"the_next_week_final_scene", make_shared<the_next_week_final_scene>()},
+    };
+
+    struct integrator_config
+    {
+        integrator_type type;
+        mis_heuristic heuristic;
+        const char *name;
+    };
+
+    const integrator_config integrators[] = {
+        {integrator_type::recursive, mis_heuristic::power, "recursive"},
+        {integrator_type::iterative, mis_heuristic::power, "iterative + russian roulette"},
+        {integrator_type::mis, mis_heuristic::balance, "mis (balance heuristic)"},
+        {integrator_type::mis, mis_heuristic::power, "mis (power heuristic)"},
+    };
+
+    for (const auto &[scene_name, scene] : scenes)
+    {
+        std::cout << "== integrator (" << scene_name << ", " << config.image_width << "px, "
+                  << config.samples_per_pixel << " spp) ==\n";
+
+        multi_thread_renderer r;
+
+        // 参考图使用不同的随机数种子，避免与被测图像共享采样
+        r.options.integrator = integrator_type::recursive;
+        r.options.seed = 1;
+        auto reference = render_scene(r, scene, config.image_width, config.samples_per_pixel * 8);
+        r.options.seed = 0;
+
+        double baseline_mse = 0;
+        for (const auto &integrator : integrators)
+        {
+            r.options.integrator = integrator.type;
+            r.options.heuristic = integrator.heuristic;
+            auto image = render_scene(r, scene, config.image_width, config.samples_per_pixel);
+            auto stats = r.get_stats();
+            auto mse = mean_squared_error(image, reference);
+            if (baseline_mse == 0)
+                baseline_mse = mse;
+
+            std::cout << std::left << std::setw(30) << integrator.name
+                      << " time " << std::setw(8) << stats.render_seconds << " s"
+                      << "  rays/s " << std::setw(12) << stats.rays / stats.render_seconds
+                      << "  mse " << std::setw(12) << mse
+                      << "  1/(mse*time) " << std::setw(12) << 1.0 / (mse * stats.render_seconds)
+                      << "  equal-noise spp " << config.samples_per_pixel * mse / baseline_mse << "\n";
+        }
+    }
+}
+
+/**
+ * @brief 统计渲染路径上的堆分配次数；以不同的采样数渲染同一场景两次，
+ * 场景构建和 frame buffer 等一次性分配在两次渲染中相同，差值即为采样过程中的分配
+ */
+void benchmark_allocations(const benchmark_config &config)
+{
+    std::cout << "== allocations (cornell_box, " << config.image_width << "px) ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<cornell_box>();
+
+    const int spp_low = 1;
+    const int spp_high = 1 + config.samples_per_pixel;
+
+    auto before = allocation_count.load();
+    render_scene(r, scene, config.image_width, spp_low);
+    auto low = allocation_count.load() - before;
+
+    before = allocation_count.load();
+    render_scene(r, scene, config.image_width, spp_high);
+    auto high = allocation_count.load() - before;
+
+    auto samples = double(spp_high - spp_low) * scene->image_width * scene->image_height;
+    std::cout << "allocations at " << spp_low << " spp: " << low << ", at " << spp_high << " spp: " << high
+              << ", per sample: " << (double(high) - double(low)) / samples << "\n";
+}
+
+/**
+ * @brief 从包围盒外向包围盒内随机发射射线，测量加速结构的求交速度；
+ * 每次调用使用相同的射线，便于比较不同的加速结构
+ *
+ * @param hits 返回击中的射线数量
+ * @return 每秒求交的射线数量
+ */
+double measure_traversal(const hittable &tree, int ray_count, int &hits)
+{
+    thread_sampler.seed(0, 0);
+
+    aabb box;
+    tree.bounding_box(0, 1, box);
+    auto center = box.centroid();
+    auto radius = (box.max() - box.min()).length();
+
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ray_count; i++)
+    {
+        auto origin = center + radius * random_unit_vector();
+        auto target = center + 0.5 * (box.max() - box.min()) * vec3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1));
+
+        hit_record rec;
+        hits += tree.hit(ray(origin, target - origin), 0.001, infinity, rec);
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return ray_count / seconds;
+}
+
+/**
+ * @brief 比较不同构建方式与内存布局的 bvh：原有的随机轴中位数划分、SAH，
+ * 以及 shared_ptr 连接的 bvh_node 与线性 bvh；输出构建耗时、SAH 代价与实际求交速度
+ */
+void benchmark_bvh(const benchmark_config &config)
+{
+    std::cout << "== bvh build & traversal ==\n";
+
+    hittable_list bunny;
+    for (const auto &tri : load_model_from_obj_file("../../res/bunny.obj", make_shared<lambertian>(color(0.5)), 2000.0f))
+        bunny.add(tri);
+
+    const std::pair<const char *, hittable_list> inputs[] = {
+        {"bunny.obj", bunny},
+        {"random_scene", random_scene().generate()},
+        {"the_next_week_final_scene", the_next_week_final_scene().generate()},
+    };
+
+    struct variant
+    {
+        const char *name;
+        bvh_split_method method;
+        bvh_layout layout;
+    };
+
+    const variant variants[] = {
+        {"median/binary", bvh_split_method::median, bvh_layout::binary},
+        {"sah/binary", bvh_split_method::sah, bvh_layout::binary},
+        {"sah/linear", bvh_split_method::sah, bvh_layout::linear},
+        {"sah/wide4", bvh_split_method::sah, bvh_layout::wide4},
+        {"sah/wide8", bvh_split_method::sah, bvh_layout::wide8},
+    };
+
+    for (const auto &[name, list] : inputs)
+    {
+        for (const auto &v : variants)
+        {
+            bvh_build_options options;
+            options.split_method = v.method;
+
+            bvh_build_stats stats;
+            shared_ptr<hittable> tree;
+            if (v.layout == bvh_layout::binary)
+                tree = make_shared<bvh_node>(list, 0.0, 1.0, options, &stats);
+            else if (v.layout == bvh_layout::linear)
+                tree = make_shared<linear_bvh>(list, 0.0, 1.0, options, &stats);
+            else if (v.layout == bvh_layout::wide4)
+                tree = make_shared<wide_bvh<4>>(list, 0.0, 1.0, options, &stats);
+            else
+                tree = make_shared<wide_bvh<8>>(list, 0.0, 1.0, options, &stats);
+
+            int hits;
+            auto rays_per_second = measure_traversal(*tree, 200000, hits);
+
+            std::cout << std::left << std::setw(28) << name << std::setw(15) << v.name << stats
+                      << ", rays/s " << rays_per_second << " (" << hits << " hits)\n";
+        }
+    }
+}
+
+/**
+ * @brief 比较串行与在线程池中并行构建 SAH bvh 的耗时；输入为随机分布的小包围盒，
+ * 模拟数百万个三角形的场景；并行构建的结果应与串行构建完全相同
+ */
+void benchmark_bvh_build(const benchmark_config &config)
+{
+    const size_t primitive_count = 2000000;
+    std::cout << "== bvh build (" << primitive_count << " random triangles) ==\n";
+
+    thread_sampler.seed(0, 0);
+    std::vector<aabb> bounds;
+    bounds.reserve(primitive_count);
+    for (size_t i = 0; i < primitive_count; i++)
+    {
+        auto p = 100.0 * vec3(random_double(), random_double(), random_double());
+        auto size = 0.1 * vec3(random_double(), random_double(), random_double());
+        bounds.push_back(aabb(p, p + size));
+    }
+
+    thread_pool pool;
+
+    bvh_build_options serial_options;
+    bvh_build_options parallel_options;
+    parallel_options.pool = &pool;
+
+    bvh_builder serial(bounds, serial_options);
+    serial.build();
+
+    bvh_builder parallel(bounds, parallel_options);
+    parallel.build();
+
+    std::cout << std::left << std::setw(28) << "serial" << serial.stats << "\n"
+              << std::setw(28) << ("parallel (" + std::to_string(pool.size()) + " threads)") << parallel.stats << "\n"
+              << "speedup " << serial.stats.build_seconds / parallel.stats.build_seconds
+              << ", identical: " << (serial.ordered_indices == parallel.ordered_indices ? "yes" : "no") << "\n";
+}
+
+/**
+ * @brief 比较两级加速结构与把每个副本的三角形直接放入同一个 bvh 的做法；
+ * 两者放置相同的 bunny 副本，输出构建耗时、估算的内存占用与求交速度；实例的包围盒由
+ * 变换后的 BLAS 包围盒得到，比展开后的更松，因此两者发射的射线略有不同
+ */
+void benchmark_instancing(const benchmark_config &config)
+{
+    const int copies = 100;
+    std::cout << "== instancing (" << copies << " copies of bunny.obj) ==\n";
+
+    auto mat = make_shared<lambertian>(color(0.5));
+    auto triangles = load_model_from_obj_file("../../res/bunny.obj", mat, 10.0f);
+
+    thread_sampler.seed(0, 0);
+    std::vector<affine_transform> transforms;
+    for (int i = 0; i < copies; i++)
+    {
+        transforms.push_back(affine_transform::translation(vec3(2 * (i % 10), 0, 2 * (i / 10))) *
+                             affine_transform::rotation(vec3(0, 1, 0), random_double(0, 360)));
+    }
+
+    // 每个副本的三角形都变换到世界空间后放入同一个 bvh
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        hittable_list flattened;
+        for (const auto &t : transforms)
+        {
+            for (const auto &tri : triangles)
+            {
+                auto v0 = vertex(t.point(tri->v0.position), tri->v0.normal, tri->v0.uv);
+                auto v1 = vertex(t.point(tri->v1.position), tri->v1.normal, tri->v1.uv);
+                auto v2 = vertex(t.point(tri->v2.position), tri->v2.normal, tri->v2.uv);
+                flattened.add(make_shared<triangle>(v0, v1, v2, mat));
+            }
+        }
+        linear_bvh tree(flattened, 0.0, 1.0);
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // 每个三角形：对象本身、shared_ptr 控制块（按 16 字节估算）和两处 shared_ptr
+        size_t bytes = flattened.objects.size() * (sizeof(triangle) + 16 + 2 * sizeof(shared_ptr<hittable>)) +
+                       tree.tree.nodes.size() * sizeof(linear_bvh_node);
+
+        int hits;
+        auto rays_per_second = measure_traversal(tree, 200000, hits);
+        std::cout << std::left << std::setw(28) << "flattened" << "build " << seconds * 1000.0 << " ms, "
+                  << bytes / (1024.0 * 1024.0) << " MiB, rays/s " << rays_per_second << " (" << hits << " hits)\n";
+    }
+
+    // bunny 只构建一次 bvh，每个副本为一个实例
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        auto blas = make_shared<mesh>("../../res/bunny.obj", mat, 10.0f);
+        hittable_list instances;
+        for (const auto &t : transforms)
+            instances.add(make_shared<instance>(blas, t));
+        linear_bvh tree(instances, 0.0, 1.0);
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t bytes = blas->memory_usage() + instances.objects.size() * (sizeof(instance) + 16 + 2 * sizeof(shared_ptr<hittable>)) +
+                       tree.tree.nodes.size() * sizeof(linear_bvh_node);
+
+        int hits;
+        auto rays_per_second = measure_traversal(tree, 200000, hits);
+        std::cout << std::left << std::setw(28) << "instanced (tlas + blas)" << "build " << seconds * 1000.0 << " ms, "
+                  << bytes / (1024.0 * 1024.0) << " MiB, rays/s " << rays_per_second << " (" << hits << " hits)\n";
+    }
+}
+
+/**
+ * @brief 比较 bunny.obj 以独立的 triangle 物体存放与以带索引的 SoA 网格存放时
+ * 每个三角形占用的字节数（均包括 bvh 节点）
+ */
+void benchmark_mesh_memory(const benchmark_config &config)
+{
+    std::cout << "== mesh memory (bunny.obj) ==\n";
+
+    auto mat = make_shared<lambertian>(color(0.5));
+
+    // 每个三角形：对象本身、make_shared 的控制块（按 16 字节估算）和列表中的 shared_ptr
+    auto list = load_model_from_obj_file("../../res/bunny.obj", mat);
+    hittable_list objects;
+    for (const auto &tri : list)
+        objects.add(tri);
+    linear_bvh tree(objects, 0.0, 1.0);
+    size_t list_bytes = list.size() * (sizeof(triangle) + 16 + sizeof(shared_ptr<hittable>)) +
+                        tree.tree.nodes.size() * sizeof(linear_bvh_node);
+
+    mesh indexed("../../res/bunny.obj", mat);
+    size_t mesh_bytes = indexed.memory_usage();
+
+    std::cout << std::left << std::setw(28) << "shared_ptr<triangle>" << list_bytes / double(list.size()) << " bytes/triangle\n"
+              << std::setw(28) << "indexed SoA mesh" << mesh_bytes / double(indexed.triangle_count()) << " bytes/triangle\n";
+
+    int list_hits, mesh_hits;
+    auto list_rays = measure_traversal(tree, 200000, list_hits);
+    auto mesh_rays = measure_traversal(indexed, 200000, mesh_hits);
+    std::cout << "rays/s " << list_rays << " (" << list_hits << " hits) -> " << mesh_rays << " (" << mesh_hits << " hits)\n";
+}
+
+/**
+ * @brief 网格求交速度：渲染 test_scene（bunny）以及直接向 bunny 网格发射射线，
+ * 分别输出每秒求交的射线数量
+ */
+void benchmark_mesh_intersection(const benchmark_config &config)
+{
+    std::cout << "== mesh intersection (test_scene, " << config.image_width << "px, "
+              << config.samples_per_pixel << " spp, packet width " << triangle_packet_width << ") ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<test_scene>();
+    render_scene(r, scene, config.image_width, config.samples_per_pixel);
+    auto stats = r.get_stats();
+
+    mesh bunny("../../res/bunny.obj", make_shared<lambertian>(color(0.5)));
+    int hits;
+    auto rays_per_second = measure_traversal(bunny, 500000, hits);
+
+    std::cout << "test_scene rays/s " << stats.rays / stats.render_seconds
+              << ", bunny.obj rays/s " << rays_per_second << " (" << hits << " hits)\n";
+}
+
+/**
+ * @brief 比较保存 shared_ptr 的线性 bvh（sphere 和 triangle 以外的物体经过虚函数求交）与按类型存放物体的 compiled_scene：
+ * 渲染 random_scene 并输出每秒射线数量，同时直接向两种加速结构发射相同的射线
+ */
+void benchmark_compiled_scene(const benchmark_config &config)
+{
+    std::cout << "== compiled scene (random_scene, " << config.image_width << "px, "
+              << config.samples_per_pixel << " spp) ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<random_scene>();
+
+    std::vector<color> images[2];
+    for (int compiled = 0; compiled < 2; compiled++)
+    {
+        scene->compiled = compiled;
+        images[compiled] = render_scene(r, scene, config.image_width, config.samples_per_pixel);
+        auto stats = r.get_stats();
+
+        std::cout << std::left << std::setw(28) << (compiled ? "compiled_scene" : "linear_bvh")
+                  << "time " << std::setw(8) << stats.render_seconds << " s  rays/s " << stats.rays / stats.render_seconds << "\n";
+    }
+    std::cout << "mse between images " << mean_squared_error(images[0], images[1]) << "\n";
+
+    // 与渲染器生成场景时使用相同的随机数序列
+    thread_sampler.use(nullptr);
+    thread_sampler.seed(0, 0);
+    auto list = scene->generate();
+    linear_bvh tree(list, 0.0, 1.0);
+    compiled_scene compiled(list, 0.0, 1.0);
+
+    int tree_hits, compiled_hits;
+    auto tree_rays = measure_traversal(tree, 500000, tree_hits);
+    auto compiled_rays = measure_traversal(compiled, 500000, compiled_hits);
+    std::cout << "traversal rays/s " << tree_rays << " (" << tree_hits << " hits) -> "
+              << compiled_rays << " (" << compiled_hits << " hits)\n";
+}
+
+/**
+ * @brief 比较均匀选择光源与按功率选择光源的收敛速度：以不同的采样数渲染 the_next_week_final_scene，
+ * 输出每种方式的耗时和相对于高采样参考图的均方误差
+ */
+void benchmark_light_selection(const benchmark_config &config)
+{
+    std::cout << "== light selection (the_next_week_final_scene, " << config.image_width << "px) ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<the_next_week_final_scene>();
+
+    r.options.seed = 1;
+    auto reference = render_scene(r, scene, config.image_width, config.samples_per_pixel * 8);
+    r.options.seed = 0;
+
+    const std::pair<light_selection_type, const char *> selections[] = {
+        {light_selection_type::uniform, "uniform"},
+        {light_selection_type::power, "power (alias table)"},
+    };
+
+    for (const auto &[selection, name] : selections)
+    {
+        r.options.light_selection = selection;
+        for (int spp = std::max(config.samples_per_pixel / 4, 1); spp <= config.samples_per_pixel; spp *= 2)
+        {
+            auto image = render_scene(r, scene, config.image_width, spp);
+            auto stats = r.get_stats();
+
+            std::cout << std::left << std::setw(22) << name << std::setw(6) << spp << "spp"
+                      << "  time " << std::setw(8) << stats.render_seconds << " s"
+                      << "  mse " << mean_squared_error(image, reference) << "\n";
+        }
+    }
+}
+
+/**
+ * @brief 一万个光源的场景中以相同的采样数比较各种光源选择方式；uniform 和 power 每次计算 pdf 都要遍历所有光源，
+ * 输出耗时、每秒射线数量以及相对于 light_bvh 高采样参考图的均方误差
+ */
+void benchmark_many_lights(const benchmark_config &config)
+{
+    const int emitter_count = many_lights::emitter_grid * many_lights::emitter_grid;
+    std::cout << "== many lights (" << emitter_count << " emitters, " << config.image_width << "px, "
+              << config.samples_per_pixel << " spp) ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<many_lights>();
+
+    r.options.light_selection = light_selection_type::bvh;
+    r.options.seed = 1;
+    auto reference = render_scene(r, scene, config.image_width, config.samples_per_pixel * 8);
+    r.options.seed = 0;
+
+    const std::pair<light_selection_type, const char *> selections[] = {
+        {light_selection_type::uniform, "uniform"},
+        {light_selection_type::power, "power (alias table)"},
+        {light_selection_type::bvh, "light bvh"},
+    };
+
+    for (const auto &[selection, name] : selections)
+    {
+        r.options.light_selection = selection;
+        auto image = render_scene(r, scene, config.image_width, config.samples_per_pixel);
+        auto stats = r.get_stats();
+
+        std::cout << std::left << std::setw(22) << name
+                  << "time " << std::setw(8) << stats.render_seconds << " s"
+                  << "  rays/s " << std::setw(12) << stats.rays / stats.render_seconds
+                  << "  mse " << mean_squared_error(image, reference) << "\n";
+    }
+}
+
+/**
+ * @brief 各个采样器的收敛速度：使用 mis 积分器以 1 到 2 倍 samples_per_pixel 的采样数渲染 cornell_box，
+ * 输出相对于高采样参考图的均方误差，以及达到 independent 在 samples_per_pixel 下的误差所需的采样数
+ * （在相邻两个采样数之间按对数插值）
+ */
+void benchmark_samplers(const benchmark_config &config)
+{
+    std::cout << "== samplers (cornell_box, mis, " << config.image_width << "px) ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<cornell_box>();
+    r.options.integrator = integrator_type::mis;
+
+    r.options.seed = 1;
+    auto reference = render_scene(r, scene, config.image_width, config.samples_per_pixel * 16);
+    r.options.seed = 0;
+
+    const std::pair<sampler_type, const char *> samplers[] = {
+        {sampler_type::independent, "independent"},
+        {sampler_type::stratified, "stratified"},
+        {sampler_type::halton, "halton"},
+        {sampler_type::sobol, "sobol (owen scrambled)"},
+    };
+
+    double target = 0;
+    for (const auto &[type, name] : samplers)
+    {
+        r.options.sampler = type;
+
+        std::vector<std::pair<int, double>> errors;
+        std::cout << std::left << std::setw(24) << name;
+        for (int spp = 1; spp <= config.samples_per_pixel * 2; spp *= 2)
+        {
+            auto mse = mean_squared_error(render_scene(r, scene, config.image_width, spp), reference);
+            errors.push_back({spp, mse});
+            if (type == sampler_type::independent && spp == config.samples_per_pixel)
+                target = mse;
+
+            std::cout << std::setw(12) << mse;
+        }
+
+        double needed = 0;
+        for (size_t i = 0; i < errors.size() && needed == 0; i++)
+        {
+            if (errors[i].second > target)
+                continue;
+
+            needed = errors[i].first;
+            if (i > 0)
+            {
+                auto [spp0, mse0] = errors[i - 1];
+                auto [spp1, mse1] = errors[i];
+                auto t = std::log(mse0 / target) / std::log(mse0 / mse1);
+                needed = spp0 * std::pow(static_cast<double>(spp1) / spp0, t);
+            }
+        }
+
+        std::cout << " spp for target mse " << target << ": ";
+        if (needed > 0)
+            std::cout << needed << "\n";
+        else
+            std::cout << "> " << config.samples_per_pixel * 2 << "\n";
+    }
+}
+
+/**
+ * @brief 比较自适应采样与固定采样数：自适应采样以 samples_per_pixel 为上限，
+ * 输出平均采样数、耗时和均方误差，并以相同的平均采样数进行固定采样作为对照
+ */
+void benchmark_adaptive(const benchmark_config &config)
+{
+    std::cout << "== adaptive sampling (cornell_box, mis, " << config.image_width << "px, up to "
+              << config.samples_per_pixel << " spp) ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<cornell_box>();
+    r.options.integrator = integrator_type::mis;
+
+    r.options.seed = 1;
+    auto reference = render_scene(r, scene, config.image_width, config.samples_per_pixel * 8);
+    r.options.seed = 0;
+
+    auto report = [&](const std::string &name, const std::vector<color> &image)
+    {
+        auto stats = r.get_stats();
+        std::cout << std::left << std::setw(26) << name
+                  << " spp " << std::setw(8) << 1.0 * stats.samples / image.size()
+                  << " time " << std::setw(8) << stats.render_seconds << " s"
+                  << "  mse " << mean_squared_error(image, reference) << "\n";
+    };
+
+    report("fixed", render_scene(r, scene, config.image_width, config.samples_per_pixel));
+    double fixed_seconds = r.get_stats().render_seconds;
+
+    for (double threshold : {0.005, 0.01, 0.02})
+    {
+        r.options.adaptive = true;
+        r.options.adaptive_threshold = threshold;
+        report("adaptive, threshold " + std::to_string(threshold).substr(0, 5),
+               render_scene(r, scene, config.image_width, config.samples_per_pixel));
+
+        // 以相同的平均采样数固定采样
+        r.options.adaptive = false;
+        int spp = static_cast<int>(1.0 * r.get_stats().samples / (r.get_sample_counts().size()) + 0.5);
+        report("  fixed, same samples", render_scene(r, scene, config.image_width, spp));
+    }
+
+    // 自适应采样与时间预算同时使用：采样数上限远大于预算内能完成的数量，应当在截止时间停止
+    r.options.adaptive = true;
+    r.options.adaptive_threshold = 0.005;
+    r.options.time_budget = fixed_seconds;
+    report("adaptive, fixed's time", render_scene(r, scene, config.image_width, config.samples_per_pixel * 64));
+    r.options.time_budget = 0;
+    r.options.adaptive = false;
+}
+
+/**
+ * @brief 比较各种图像格式的文件大小和写入耗时；P3 为原来逐像素以文本写入的方式，
+ * 其余格式先在内存中组装再一次写入。图像内容不影响未压缩格式的大小，只以 1 spp 渲染
+ */
+void benchmark_image_io(const benchmark_config &config)
+{
+    int width = config.image_width;
+    std::cout << "== image output (cornell_box, " << width << "x" << width << ") ==\n";
+
+    multi_thread_renderer r;
+    auto scene = make_shared<cornell_box>();
+    auto image = render_scene(r, scene, width, 1);
+
+    auto report = [&](const std::string &name, const std::string &filename, auto write)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        write(filename);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        auto bytes = static_cast<long long>(file.tellg());
+        file.close();
+        std::remove(filename.c_str());
+
+        std::cout << std::left << std::setw(22) << name
+                  << " size " << std::setw(10) << bytes << " bytes"
+                  << "  time " << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+    };
+
+    report("P3 (text, per pixel)", "benchmark_p3.ppm", [&](const std::string &filename)
+           {
+               std::ofstream output(filename);
+               output << "P3\n" << width << ' ' << width << "\n255\n";
+               for (const auto &pixel : image)
+                   write_color(output, pixel, 1); });
+    report("P6 (binary)", "benchmark_p6.ppm", [&](const std::string &filename)
+           { write_ppm(filename, image, width, width); });
+    report("PFM (float)", "benchmark.pfm", [&](const std::string &filename)
+           { write_pfm(filename, image, width, width); });
+    report("EXR (half)", "benchmark_half.exr", [&](const std::string &filename)
+           { write_exr(filename, image, width, width, exr_pixel_type::half); });
+    report("EXR (float)", "benchmark_float.exr", [&](const std::string &filename)
+           { write_exr(filename, image, width, width, exr_pixel_type::single); });
+}
+
+int main(int argc, char **argv)
+{
+    std::string which = argc > 1 ? argv[1] : "all";
+
+    benchmark_config config;
+    if (argc > 2)
+        config.image_width = std::stoi(argv[2]);
+    if (argc > 3)
+        config.samples_per_pixel = std::stoi(argv[3]);
+
+    std::cout << std::setprecision(4);
+    std::cout << "isa: " << active_isa() << ", scalar: " << (sizeof(real) == sizeof(float) ? "float" : "double") << "\n";
+
+    if (which == "all" || which == "integrator")
+        benchmark_integrator(config);
+    if (which == "all" || which == "bvh")
+        benchmark_bvh(config);
+    if (which == "all" || which == "bvh_build")
+        benchmark_bvh_build(config);
+    if (which == "all" || which == "instancing")
+        benchmark_instancing(config);
+    if (which == "all" || which == "mesh_memory")
+        benchmark_mesh_memory(config);
+    if (which == "all" || which == "mesh")
+        benchmark_mesh_intersection(config);
+    if (which == "all" || which == "compiled")
+        benchmark_compiled_scene(config);
+    if (which == "all" || which == "lights")
+        benchmark_light_selection(config);
+    if (which == "all" || which == "many_lights")
+        benchmark_many_lights(config);
+    if (which == "all" || which == "samplers")
+        benchmark_samplers(config);
+    if (which == "all" || which == "adaptive")
+        benchmark_adaptive(config);
+    if (which == "all" || which == "image_io")
+        benchmark_image_io(config);
+    if (which == "all" || which == "allocations")
+        benchmark_allocations(config);
+
+    return 0;
+}
@@ -17,6 +17,11 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return sides.hit_any(r, t_min, t_max);
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         output_box = aabb(box_min, box_max);
@@ -1,10 +1,428 @@
 #ifndef BVH_H
 #define BVH_H
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
 #include "rtweekend.h"
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include "thread_pool.h"
+
+/**
+ * @brief bvh 的划分方式
+ */
+enum class bvh_split_method
+{
+    sah,    // 分桶（binned）表面积启发式
+    median, // 随机选择一个轴，按包围盒最小端排序后从中间划分
+};
+
+/**
+ * @brief bvh 的内存布局
+ */
+enum class bvh_layout
+{
+    binary, // 由 shared_ptr 连接的 bvh_node 树
+    linear, // 连续存放的二叉 linear_bvh 节点数组
+    wide4,  // 每个节点 4 个子节点的宽 bvh，一次 SIMD 测试 4 个包围盒
+    wide8,  // 每个节点 8 个子节点的宽 bvh
+};
+
+/**
+ * @brief bvh 的最大深度（根节点为第 1 层）；bvh_builder 保证构建得到的树不超过该深度，
+ * 各种展开后的 bvh 按它确定遍历栈的大小
+ */
+constexpr int bvh_max_depth = 64;
+
+/**
+ * @brief bvh 构建选项
+ */
+struct bvh_build_options
+{
+    bvh_split_method split_method = bvh_split_method::sah;
+    int max_leaf_size = 4;         // 叶节点最多包含的物体数量
+    int bin_count = 16;            // SAH 每个轴上的分桶数量
+    double traversal_cost = 0.125; // 遍历一个节点的代价，以一次物体求交的代价为 1
+    int leaf_packet_width = 1;     // 叶节点中的物体每几个一组同时求交，SAH 按组数计算求交代价
+    thread_pool *pool = nullptr;   // 不为空时使用该线程池并行构建（仅 SAH）
+};
+
+/**
+ * @brief bvh 构建统计信息，用于比较不同构建方式得到的树的质量
+ */
+struct bvh_build_stats
+{
+    size_t primitive_count = 0;
+    int node_count = 0;
+    int leaf_count = 0;
+    int max_depth = 0;
+    double sah_cost = 0;      // 按 SAH 估计的一条射线的平均求交代价
+    double build_seconds = 0; // 构建耗时
+};
+
+inline std::ostream &operator<<(std::ostream &out, const bvh_build_stats &stats)
+{
+    return out << stats.primitive_count << " primitives, "
+               << stats.node_count << " nodes, "
+               << stats.leaf_count << " leaves, depth "
+               << stats.max_depth << ", SAH cost "
+               << stats.sah_cost << ", "
+               << stats.build_seconds * 1000.0 << " ms";
+}
+
+/**
+ * @brief 构建过程中使用的临时节点；叶节点引用 bvh_builder::ordered_indices 中
+ * [first, first + count) 范围内的物体
+ */
+struct bvh_build_node
+{
+    aabb bounds;
+    std::unique_ptr<bvh_build_node> children[2];
+    int split_axis = 0;
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    bool is_leaf() const { return count > 0; }
+};
+
+/**
+ * @brief 只依赖物体包围盒的 bvh 构建器；预先计算每个物体的包围盒和中心点，
+ * 在一个下标数组上原地划分，不复制物体数组
+ */
+class bvh_builder
+{
+public:
+    bvh_builder(std::vector<aabb> primitive_bounds, const bvh_build_options &options = bvh_build_options())
+        : bounds(std::move(primitive_bounds)), options(options)
+    {
+        centroids.reserve(bounds.size());
+        for (const auto &b : bounds)
+            centroids.push_back(b.centroid());
+
+        ordered_indices.resize(bounds.size());
+        for (uint32_t i = 0; i < ordered_indices.size(); i++)
+            ordered_indices[i] = i;
+    }
+
+    /**
+     * @brief 构建 bvh 树，构建完成后 ordered_indices 按叶节点的顺序排列物体下标
+     */
+    std::unique_ptr<bvh_build_node> build()
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        stats = bvh_build_stats();
+        stats.primitive_count = bounds.size();
+
+        std::unique_ptr<bvh_build_node> root;
+        if (!bounds.empty())
+        {
+            root = build_recursive(0, static_cast<uint32_t>(bounds.size()), 1);
+            collect_stats(*root, 1);
+            stats.sah_cost = sah_cost(*root, root->bounds.surface_area());
+        }
+
+        stats.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return root;
+    }
+
+public:
+    std::vector<uint32_t> ordered_indices;
+    bvh_build_stats stats;
+
+private:
+    std::vector<aabb> bounds;
+    std::vector<point3> centroids;
+    bvh_build_options options;
+
+    // 物体数量不少于该值的节点，其子树作为单独的任务构建
+    static constexpr uint32_t parallel_subtree_size = 4096;
+    // 物体数量不少于该值的节点，包围盒计算和分桶也拆分为多个任务
+    static constexpr uint32_t parallel_scan_size = 65536;
+
+    static aabb empty_box()
+    {
+        return aabb(point3(infinity), point3(-infinity));
+    }
+
+    bool parallel(uint32_t count, uint32_t threshold) const
+    {
+        return options.pool && options.split_method == bvh_split_method::sah && count >= threshold;
+    }
+
+    /**
+     * @brief 计算 [start, end) 范围内物体的包围盒以及中心点的包围盒
+     */
+    void range_bounds(uint32_t start, uint32_t end, aabb &node_bounds, aabb &centroid_bounds) const
+    {
+        auto scan = [this](uint32_t b, uint32_t e, aabb &nb, aabb &cb)
+        {
+            nb = empty_box();
+            cb = empty_box();
+            for (uint32_t i = b; i < e; i++)
+            {
+                nb = surrounding_box(nb, bounds[ordered_indices[i]]);
+                cb = surrounding_box(cb, aabb(centroids[ordered_indices[i]], centroids[ordered_indices[i]]));
+            }
+        };
+
+        if (!parallel(end - start, parallel_scan_size))
+        {
+            scan(start, end, node_bounds, centroid_bounds);
+            return;
+        }
+
+        // 每个区间的结果单独保存，最后按区间顺序合并
+        const uint32_t grain = parallel_scan_size / 4;
+        std::vector<std::pair<aabb, aabb>> partial((end - start + grain - 1) / grain);
+        options.pool->parallel_for(start, end, grain, [&](size_t b, size_t e)
+                                   {
+                                       auto &p = partial[(b - start) / grain];
+                                       scan(static_cast<uint32_t>(b), static_cast<uint32_t>(e), p.first, p.second); });
+
+        node_bounds = empty_box();
+        centroid_bounds = empty_box();
+        for (const auto &p : partial)
+        {
+            node_bounds = surrounding_box(node_bounds, p.first);
+            centroid_bounds = surrounding_box(centroid_bounds, p.second);
+        }
+    }
+
+    std::unique_ptr<bvh_build_node> make_leaf(const aabb &node_bounds, uint32_t start, uint32_t end)
+    {
+        auto node = std::make_unique<bvh_build_node>();
+        node->bounds = node_bounds;
+        node->first = start;
+        node->count = end - start;
+        return node;
+    }
+
+    /**
+     * @brief 构建 [start, end) 范围内物体的子树；设置了线程池时，较大的子树在线程池中
+     * 并行构建，每个子树只修改 ordered_indices 中属于自己的区间，结果与串行构建相同
+     *
+     * @param depth 子树根节点所在的层数；保持 depth + ceil(log2(物体数量)) 不超过 bvh_max_depth，
+     * 因此之后总能通过按中位数划分在深度上限内完成构建
+     */
+    std::unique_ptr<bvh_build_node> build_recursive(uint32_t start, uint32_t end, int depth)
+    {
+        aabb node_bounds, centroid_bounds;
+        range_bounds(start, end, node_bounds, centroid_bounds);
+
+        uint32_t count = end - start;
+        if (count == 1)
+            return make_leaf(node_bounds, start, end);
+
+        int axis = 0;
+        uint32_t mid = start + count / 2;
+
+        if (options.split_method == bvh_split_method::median)
+        {
+            axis = random_int(0, 2);
+            std::nth_element(ordered_indices.begin() + start, ordered_indices.begin() + mid, ordered_indices.begin() + end,
+                             [&](uint32_t a, uint32_t b)
+                             { return bounds[a].min()[axis] < bounds[b].min()[axis]; });
+        }
+        else
+        {
+            axis = centroid_bounds.longest_axis();
+            double extent = centroid_bounds.max()[axis] - centroid_bounds.min()[axis];
+
+            if (extent <= 0)
+            {
+                // 所有物体的中心点重合，无法按中心点划分
+                if (count <= static_cast<uint32_t>(options.max_leaf_size))
+                    return make_leaf(node_bounds, start, end);
+            }
+            else
+            {
+                int split_bin = find_sah_split(start, end, node_bounds, centroid_bounds, axis, count);
+                if (split_bin < 0)
+                    return make_leaf(node_bounds, start, end);
+
+                auto split = std::partition(ordered_indices.begin() + start, ordered_indices.begin() + end,
+                                            [&](uint32_t index)
+                                            { return bin_index(centroids[index], centroid_bounds, axis) <= split_bin; });
+                mid = static_cast<uint32_t>(split - ordered_indices.begin());
+
+                if (mid == start || mid == end)
+                    mid = start + count / 2;
+
+                // 物体分布极不均匀时 SAH 每次只分出很少的物体，树的深度会随物体数量线性增长；
+                // 较大的子树在剩余的层数内放不下时改为按中心点的中位数划分
+                if (depth + 1 + ceil_log2(std::max(mid - start, end - mid)) > bvh_max_depth)
+                {
+                    mid = start + count / 2;
+                    std::nth_element(ordered_indices.begin() + start, ordered_indices.begin() + mid, ordered_indices.begin() + end,
+                                     [&](uint32_t a, uint32_t b)
+                                     { return centroids[a][axis] < centroids[b][axis]; });
+                }
+            }
+        }
+
+        auto node = std::make_unique<bvh_build_node>();
+        node->bounds = node_bounds;
+        node->split_axis = axis;
+
+        if (parallel(count, parallel_subtree_size))
+        {
+            thread_pool::task_group group;
+            options.pool->submit(group, [&](int)
+                                 { node->children[0] = build_recursive(start, mid, depth + 1); });
+            node->children[1] = build_recursive(mid, end, depth + 1);
+            options.pool->wait(group);
+        }
+        else
+        {
+            node->children[0] = build_recursive(start, mid, depth + 1);
+            node->children[1] = build_recursive(mid, end, depth + 1);
+        }
+
+        return node;
+    }
+
+    void collect_stats(const bvh_build_node &node, int depth)
+    {
+        stats.node_count++;
+        stats.max_depth = std::max(stats.max_depth, depth);
+
+        if (node.is_leaf())
+        {
+            stats.leaf_count++;
+            return;
+        }
+
+        collect_stats(*node.children[0], depth + 1);
+        collect_stats(*node.children[1], depth + 1);
+    }
+
+    static int ceil_log2(uint32_t n)
+    {
+        int bits = 0;
+        while ((uint64_t(1) << bits) < n)
+            bits++;
+        return bits;
+    }
+
+    int bin_index(const point3 &centroid, const aabb &centroid_bounds, int axis) const
+    {
+        double extent = centroid_bounds.max()[axis] - centroid_bounds.min()[axis];
+        int b = static_cast<int>(options.bin_count * (centroid[axis] - centroid_bounds.min()[axis]) / extent);
+        return std::min(b, options.bin_count - 1);
+    }
+
+    /**
+     * @brief 在指定轴上按分桶的 SAH 寻找最佳划分位置
+     *
+     * @return 最佳划分所在的桶（该桶及之前的物体划分到左子树）；
+     * 当物体数量不超过叶节点容量并且不划分的代价更低时返回 -1
+     */
+    int find_sah_split(uint32_t start, uint32_t end, const aabb &node_bounds, const aabb &centroid_bounds, int axis, uint32_t count) const
+    {
+        struct bin
+        {
+            aabb bounds = empty_box();
+            int count = 0;
+        };
+
+        auto fill_bins = [&](uint32_t b, uint32_t e, std::vector<bin> &bins)
+        {
+            for (uint32_t i = b; i < e; i++)
+            {
+                auto &target = bins[bin_index(centroids[ordered_indices[i]], centroid_bounds, axis)];
+                target.count++;
+                target.bounds = surrounding_box(target.bounds, bounds[ordered_indices[i]]);
+            }
+        };
+
+        std::vector<bin> bins(options.bin_count);
+        if (!parallel(count, parallel_scan_size))
+        {
+            fill_bins(start, end, bins);
+        }
+        else
+        {
+            const uint32_t grain = parallel_scan_size / 4;
+            std::vector<std::vector<bin>> partial((count + grain - 1) / grain, std::vector<bin>(options.bin_count));
+            options.pool->parallel_for(start, end, grain, [&](size_t b, size_t e)
+                                       { fill_bins(static_cast<uint32_t>(b), static_cast<uint32_t>(e), partial[(b - start) / grain]); });
+
+            for (const auto &p : partial)
+            {
+                for (int i = 0; i < options.bin_count; i++)
+                {
+                    bins[i].count += p[i].count;
+                    bins[i].bounds = surrounding_box(bins[i].bounds, p[i].bounds);
+                }
+            }
+        }
+
+        // 从右向左扫描一遍，记录每个划分位置右侧的包围盒面积与物体数量
+        std::vector<double> right_area(options.bin_count, 0.0);
+        std::vector<int> right_count(options.bin_count, 0);
+        aabb right_box = empty_box();
+        int right_sum = 0;
+        for (int i = options.bin_count - 1; i > 0; i--)
+        {
+            right_box = surrounding_box(right_box, bins[i].bounds);
+            right_sum += bins[i].count;
+            right_area[i - 1] = right_sum > 0 ? right_box.surface_area() : 0.0;
+            right_count[i - 1] = right_sum;
+        }
+
+        double best_cost = infinity;
+        int best_bin = -1;
+        aabb left_box = empty_box();
+        int left_sum = 0;
+        for (int i = 0; i < options.bin_count - 1; i++)
+        {
+            left_box = surrounding_box(left_box, bins[i].bounds);
+            left_sum += bins[i].count;
+            if (left_sum == 0 || right_count[i] == 0)
+                continue;
+
+            double cost = intersection_cost(left_sum) * left_box.surface_area() + intersection_cost(right_count[i]) * right_area[i];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_bin = i;
+            }
+        }
+
+        double node_area = node_bounds.surface_area();
+        double split_cost = options.traversal_cost + (node_area > 0 ? best_cost / node_area : 0.0);
+        double leaf_cost = intersection_cost(count);
+
+        if (count <= static_cast<uint32_t>(options.max_leaf_size) && leaf_cost <= split_cost)
+            return -1;
+
+        return best_bin;
+    }
+
+    /**
+     * @brief 与 count 个物体求交的代价
+     */
+    double intersection_cost(uint32_t count) const
+    {
+        return (count + options.leaf_packet_width - 1) / options.leaf_packet_width;
+    }
+
+    double sah_cost(const bvh_build_node &node, double root_area) const
+    {
+        double p = root_area > 0 ? node.bounds.surface_area() / root_area : 1.0;
+
+        if (node.is_leaf())
+            return p * intersection_cost(node.count);
+
+        return p * options.traversal_cost +
+               sah_cost(*node.children[0], root_area) +
+               sah_cost(*node.children[1], root_area);
+    }
+};
 
 /**
  * @brief bvh 树节点，通过递归创建 bvh 节点构成 bvh 树；bvh node 同样继承自
@@ -21,9 +439,12 @@ public:
      * @param list hittable_list 实例
      * @param time0 相机快门时间下限
      * @param time1 相机快门时间上限
+     * @param options 构建选项
+     * @param stats 不为空时用于保存构建统计信息
      */
-    bvh_node(const hittable_list &list, double time0, double time1)
-        : bvh_node(list.objects, 0, list.objects.size(), time0, time1)
+    bvh_node(const hittable_list &list, double time0, double time1,
+             const bvh_build_options &options = bvh_build_options(), bvh_build_stats *stats = nullptr)
+        : bvh_node(list.objects, 0, list.objects.size(), time0, time1, options, stats)
     {
     }
 
@@ -32,107 +453,129 @@ public:
      *
      * @param src_objects 目标数组
      * @param start 起始下标（包含）
-     * @param end 终止下标（包含）
+     * @param end 终止下标（不包含）
      * @param time0 相机快门时间下限
      * @param time1 相机快门时间上限
+     * @param options 构建选项
+     * @param stats 不为空时用于保存构建统计信息
      */
     bvh_node(const std::vector<shared_ptr<hittable>> &src_objects,
-             size_t start, size_t end, double time0, double time1);
+             size_t start, size_t end, double time0, double time1,
+             const bvh_build_options &options = bvh_build_options(), bvh_build_stats *stats = nullptr);
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override;
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override;
 
 public:
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
     aabb box;
-};
 
-inline bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis)
-{
-    aabb box_a;
-    aabb box_b;
-
-    if (!a->bounding_box(0, 0, box_a) || !b->bounding_box(0, 0, box_b))
-        std::cerr << "No bounding box in bvh_node constructor.\n";
+private:
+    /**
+     * @brief 将构建器生成的临时节点转换为 bvh_node
+     */
+    bvh_node(const bvh_build_node &node, const std::vector<shared_ptr<hittable>> &objects,
+             const std::vector<uint32_t> &ordered_indices);
 
-    return box_a.min().e[axis] < box_b.min().e[axis];
-}
+    static shared_ptr<hittable> make_child(const bvh_build_node &node, const std::vector<shared_ptr<hittable>> &objects,
+                                           const std::vector<uint32_t> &ordered_indices);
+};
 
-bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
+/**
+ * @brief 计算物体在快门时间内的包围盒
+ */
+inline std::vector<aabb> primitive_bounds(const std::vector<shared_ptr<hittable>> &objects,
+                                          size_t start, size_t end, double time0, double time1)
 {
-    return box_compare(a, b, 0);
-}
+    std::vector<aabb> bounds(end - start);
 
-bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
-{
-    return box_compare(a, b, 1);
-}
+    for (size_t i = start; i < end; i++)
+    {
+        if (!objects[i]->bounding_box(time0, time1, bounds[i - start]))
+            std::cerr << "No bounding box in bvh_node constructor.\n";
+    }
 
-bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b)
-{
-    return box_compare(a, b, 2);
+    return bounds;
 }
 
 bvh_node::bvh_node(const std::vector<shared_ptr<hittable>> &src_objects,
-                   size_t start, size_t end, double time0, double time1)
+                   size_t start, size_t end, double time0, double time1,
+                   const bvh_build_options &options, bvh_build_stats *stats)
 {
-    // Create a modifiable array of the source scene objects
-    auto objects = src_objects;
+    std::vector<shared_ptr<hittable>> objects(src_objects.begin() + start, src_objects.begin() + end);
 
-    int axis = random_int(0, 2);
-    auto comparator = (axis == 0)   ? box_x_compare
-                      : (axis == 1) ? box_y_compare
-                                    : box_z_compare;
+    bvh_builder builder(primitive_bounds(objects, 0, objects.size(), time0, time1), options);
+    auto root = builder.build();
 
-    size_t object_span = end - start;
+    if (stats)
+        *stats = builder.stats;
 
-    if (object_span == 1)
-    {
-        left = right = objects[start];
-    }
-    else if (object_span == 2)
+    if (!root)
+        return;
+
+    if (root->is_leaf())
     {
-        if (comparator(objects[start], objects[start + 1]))
-        {
-            left = objects[start];
-            right = objects[start + 1];
-        }
-        else
-        {
-            left = objects[start + 1];
-            right = objects[start];
-        }
+        left = right = make_child(*root, objects, builder.ordered_indices);
+        box = root->bounds;
     }
     else
     {
-        std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-        auto mid = start + object_span / 2;
-        left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+        *this = bvh_node(*root, objects, builder.ordered_indices);
     }
+}
 
-    aabb box_left, box_right;
+bvh_node::bvh_node(const bvh_build_node &node, const std::vector<shared_ptr<hittable>> &objects,
+                   const std::vector<uint32_t> &ordered_indices)
+    : box(node.bounds)
+{
+    left = make_child(*node.children[0], objects, ordered_indices);
+    right = make_child(*node.children[1], objects, ordered_indices);
+}
+
+shared_ptr<hittable> bvh_node::make_child(const bvh_build_node &node, const std::vector<shared_ptr<hittable>> &objects,
+                                          const std::vector<uint32_t> &ordered_indices)
+{
+    if (!node.is_leaf())
+        return shared_ptr<bvh_node>(new bvh_node(node, objects, ordered_indices));
+
+    if (node.count == 1)
+        return objects[ordered_indices[node.first]];
 
-    if (!left->bounding_box(time0, time1, box_left) || !right->bounding_box(time0, time1, box_right))
-        std::cerr << "No bounding box in bvh_node constructor.\n";
+    // 包含多个物体的叶节点用 hittable_list 保存
+    auto leaf = make_shared<hittable_list>();
+    for (uint32_t i = node.first; i < node.first + node.count; i++)
+        leaf->add(objects[ordered_indices[i]]);
 
-    box = surrounding_box(box_left, box_right);
+    return leaf;
 }
 
 bool bvh_node::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
 {
-    if (!box.hit(r, t_min, t_max))
+    if (!left || !box.hit(r, t_min, t_max))
         return false;
 
+    // 只有一个子节点时（left 与 right 相同），不需要重复求交
+    if (left == right)
+        return left->hit(r, t_min, t_max, rec);
+
     bool hit_left = left->hit(r, t_min, t_max, rec);
     bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
 
     return hit_left || hit_right;
 }
 
+bool bvh_node::hit_any(const ray &r, double t_min, double t_max) const
+{
+    if (!left || !box.hit(r, t_min, t_max))
+        return false;
+
+    return left->hit_any(r, t_min, t_max) || (left != right && right->hit_any(r, t_min, t_max));
+}
+
 bool bvh_node::bounding_box(double time0, double time1, aabb &output_box) const
 {
     output_box = box;
@@ -40,11 +40,16 @@ public:
         time1 = _time1;
     }
 
-    ray get_ray(double s, double t) const
+    /**
+     * @brief 生成穿过视口 (s, t) 的射线，强制内联到按指令集生成多个版本的 renderer::render_samples 中
+     */
+    RTW_FORCE_INLINE ray get_ray(double s, double t) const
     {
+        thread_sampler.begin_phase(sample_phase::lens);
         vec3 rd = lens_radius * random_in_unit_disk();
         vec3 offset = u * rd.x() + v * rd.y();
 
+        thread_sampler.begin_phase(sample_phase::time);
         return ray(
             origin + offset,
             lower_left_corner + s * horizontal + t * vertical - origin - offset,
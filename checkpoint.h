@@ -0,0 +1,157 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <string>
+#include <vector>
+
+#include "rtweekend.h"
+
+/**
+ * @brief 渲染的检查点：每个像素的采样之和与采样数；采样器按 (像素, 采样序号) 生成随机数，
+ * 因此随机数的状态完全由种子、采样器类型、创建采样器时的采样数和每个像素的采样数决定，
+ * 继续渲染时沿用检查点中的采样器参数，接着各像素已有的采样数即可；自定义的采样器无法按类型重新创建，
+ * 继续渲染时需要提供键相同的采样器
+ */
+struct render_checkpoint
+{
+    int image_width = 0;
+    int image_height = 0;
+    uint64_t scene_key = 0; // scene_checkpoint_key
+    uint64_t seed = 0;
+    uint32_t sampler = 0;     // sampler_type，使用 render_options::custom_sampler 时为 custom_sampler
+    uint32_t sampler_spp = 0; // 创建采样器时的每像素采样数，分层采样的网格和 Halton 序列的位数由它决定
+    uint64_t sampler_key = 0; // sampler::key()，用于发现参数不同的采样器
+    uint32_t integrator = 0;  // integrator_type
+
+    static constexpr uint32_t custom_sampler = 0xffffffffu;
+    std::vector<color> accumulated;
+    std::vector<int> sample_counts;
+};
+
+/**
+ * @brief 区分场景的键：对场景名称（输出文件名）、最大弹射次数和背景颜色做 FNV-1a 哈希，
+ * 分辨率相同的另一个场景的检查点不会被误用
+ */
+inline uint64_t scene_checkpoint_key(const std::string &name, int max_depth, const color &background)
+{
+    uint64_t key = 0xcbf29ce484222325ull;
+    auto add = [&](const void *data, size_t size)
+    {
+        auto bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++)
+            key = (key ^ bytes[i]) * 0x100000001b3ull;
+    };
+
+    add(name.data(), name.size());
+    add(&max_depth, sizeof(max_depth));
+    for (int c = 0; c < 3; c++)
+    {
+        double value = background[c];
+        add(&value, sizeof(value));
+    }
+
+    return key;
+}
+
+/**
+ * @brief 以二进制格式保存检查点；采样之和以双精度保存，继续渲染的结果与不中断时逐位相同。
+ * 先写入临时文件再重命名，进程在写入过程中被终止时不会破坏已有的检查点；
+ * 使用 std::filesystem::rename 替换已有的检查点，std::rename 在 Windows 上目标文件存在时会失败
+ *
+ * 格式（小端）：8 字节标识 "RTWCKPT3"，宽、高（uint32），场景键、种子（uint64），采样器、采样器的采样数（uint32），
+ * 采样器的键（uint64），积分器（uint32），之后为按 frame buffer 顺序排列的每个像素的 3 个 double，
+ * 最后为每个像素的采样数（uint32）
+ *
+ * @return 写入成功时返回 true
+ */
+inline bool write_checkpoint(const std::string &filename, const render_checkpoint &checkpoint)
+{
+    auto temp_filename = filename + ".tmp";
+    {
+        std::ofstream file(temp_filename, std::ios::binary);
+        if (!file)
+            return false;
+
+        auto write_u32 = [&](uint32_t x)
+        { file.write(reinterpret_cast<const char *>(&x), sizeof(x)); };
+
+        file.write("RTWCKPT3", 8);
+        write_u32(static_cast<uint32_t>(checkpoint.image_width));
+        write_u32(static_cast<uint32_t>(checkpoint.image_height));
+        file.write(reinterpret_cast<const char *>(&checkpoint.scene_key), sizeof(checkpoint.scene_key));
+        file.write(reinterpret_cast<const char *>(&checkpoint.seed), sizeof(checkpoint.seed));
+        write_u32(checkpoint.sampler);
+        write_u32(checkpoint.sampler_spp);
+        file.write(reinterpret_cast<const char *>(&checkpoint.sampler_key), sizeof(checkpoint.sampler_key));
+        write_u32(checkpoint.integrator);
+
+        std::vector<double> values(checkpoint.accumulated.size() * 3);
+        for (size_t i = 0; i < checkpoint.accumulated.size(); i++)
+        {
+            for (int c = 0; c < 3; c++)
+                values[i * 3 + c] = checkpoint.accumulated[i][c];
+        }
+        file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(double));
+
+        std::vector<uint32_t> counts(checkpoint.sample_counts.begin(), checkpoint.sample_counts.end());
+        file.write(reinterpret_cast<const char *>(counts.data()), counts.size() * sizeof(uint32_t));
+
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_filename, filename, error);
+    return !error;
+}
+
+/**
+ * @brief 读取 write_checkpoint 保存的检查点
+ *
+ * @return 读取成功时返回 true
+ */
+inline bool read_checkpoint(const std::string &filename, render_checkpoint &checkpoint)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    char magic[8];
+    uint32_t width, height;
+    if (!file.read(magic, 8) || std::string(magic, 8) != "RTWCKPT3")
+        return false;
+
+    file.read(reinterpret_cast<char *>(&width), sizeof(width));
+    file.read(reinterpret_cast<char *>(&height), sizeof(height));
+    file.read(reinterpret_cast<char *>(&checkpoint.scene_key), sizeof(checkpoint.scene_key));
+    file.read(reinterpret_cast<char *>(&checkpoint.seed), sizeof(checkpoint.seed));
+    file.read(reinterpret_cast<char *>(&checkpoint.sampler), sizeof(checkpoint.sampler));
+    file.read(reinterpret_cast<char *>(&checkpoint.sampler_spp), sizeof(checkpoint.sampler_spp));
+    file.read(reinterpret_cast<char *>(&checkpoint.sampler_key), sizeof(checkpoint.sampler_key));
+    file.read(reinterpret_cast<char *>(&checkpoint.integrator), sizeof(checkpoint.integrator));
+    if (!file || width == 0 || height == 0 || checkpoint.sampler_spp == 0)
+        return false;
+
+    checkpoint.image_width = static_cast<int>(width);
+    checkpoint.image_height = static_cast<int>(height);
+    size_t pixel_count = static_cast<size_t>(width) * height;
+
+    std::vector<double> values(pixel_count * 3);
+    std::vector<uint32_t> counts(pixel_count);
+    if (!file.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(double)) ||
+        !file.read(reinterpret_cast<char *>(counts.data()), counts.size() * sizeof(uint32_t)))
+        return false;
+
+    checkpoint.accumulated.resize(pixel_count);
+    for (size_t i = 0; i < pixel_count; i++)
+        checkpoint.accumulated[i] = color(values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+    checkpoint.sample_counts.assign(counts.begin(), counts.end());
+
+    return true;
+}
+
+#endif
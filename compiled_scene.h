@@ -0,0 +1,238 @@
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "aa_rect.h"
+#include "box.h"
+#include "triangle.h"
+#include "bvh.h"
+#include "linear_bvh.h"
+
+/**
+ * @brief compiled_scene 中物体的类型
+ */
+enum class primitive_type : uint32_t
+{
+    sphere,
+    moving_sphere,
+    xy_rect,
+    xz_rect,
+    yz_rect,
+    triangle,
+    other, // 无法展开的物体（如 mesh、实例、体积），仍然通过虚函数求交
+};
+
+/**
+ * @brief 带类型标记的物体下标，index 为物体在对应类型数组中的下标
+ */
+struct primitive_ref
+{
+    primitive_type type;
+    uint32_t index;
+};
+
+/**
+ * @brief 编译后的场景：把 hittable_list 中的物体按类型复制到各自的连续数组中，
+ * 在所有物体上构建一个线性 bvh，叶节点通过带类型标记的下标引用物体，
+ * 求交时按类型分支，直接调用各类型非虚的求交函数（sphere 和 triangle 的 intersect，其余类型以限定名调用 hit），
+ * 不经过虚函数表，求交代码内联到按指令集生成多个版本的 bvh 遍历循环中
+ *
+ * hittable 的各个子类仍然是构建场景的接口；box 会被展开为六个矩形，嵌套的 hittable_list
+ * 会被展开为其中的物体，其余类型保存为 shared_ptr 并通过虚函数求交
+ */
+class compiled_scene : public hittable
+{
+public:
+    compiled_scene() {}
+
+    /**
+     * @param list 场景中的物体
+     * @param time0 相机快门时间下限
+     * @param time1 相机快门时间上限
+     * @param options 构建选项
+     * @param stats 不为空时用于保存构建统计信息
+     */
+    compiled_scene(const hittable_list &list, double time0, double time1,
+                   const bvh_build_options &options = bvh_build_options(), bvh_build_stats *stats = nullptr)
+    {
+        std::vector<primitive_ref> refs;
+        std::vector<aabb> bounds;
+        for (const auto &object : list.objects)
+            add(object, time0, time1, refs, bounds);
+
+        bvh_builder builder(std::move(bounds), options);
+        auto root = builder.build();
+
+        if (stats)
+            *stats = builder.stats;
+
+        if (!root)
+            return;
+
+        box = root->bounds;
+        tree = linear_bvh_tree(root.get());
+
+        primitives.reserve(builder.ordered_indices.size());
+        for (auto index : builder.ordered_indices)
+            primitives.push_back(refs[index]);
+    }
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        return tree.traverse(r, t_min, t_max, [&](uint32_t index, double t_min, double &t_max) RTW_FORCE_INLINE
+                             {
+                                 if (!hit_primitive(primitives[index], r, t_min, t_max, rec))
+                                     return false;
+
+                                 t_max = rec.t;
+                                 return true; });
+    }
+
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return tree.traverse_leaves(
+            r, t_min, t_max, [&](uint32_t first, uint32_t count, double t_min, double &t_max) RTW_FORCE_INLINE
+            {
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    if (hit_any_primitive(primitives[i], r, t_min, t_max))
+                        return true;
+                }
+                return false; },
+            true);
+    }
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = box;
+        return !tree.empty();
+    }
+
+    /**
+     * @brief 场景中的物体数量（box 按六个矩形计算）
+     */
+    size_t primitive_count() const { return primitives.size(); }
+
+public:
+    std::vector<sphere> spheres;
+    std::vector<moving_sphere> moving_spheres;
+    std::vector<xy_rect> xy_rects;
+    std::vector<xz_rect> xz_rects;
+    std::vector<yz_rect> yz_rects;
+    std::vector<triangle> triangles;
+    std::vector<shared_ptr<hittable>> others;
+
+    std::vector<primitive_ref> primitives; // 按叶节点顺序排列的物体
+    linear_bvh_tree tree;
+    aabb box;
+
+private:
+    RTW_FORCE_INLINE bool hit_primitive(primitive_ref p, const ray &r, double t_min, double t_max, hit_record &rec) const
+    {
+        switch (p.type)
+        {
+        case primitive_type::sphere:
+            return spheres[p.index].intersect(r, t_min, t_max, rec);
+        case primitive_type::moving_sphere:
+            return moving_spheres[p.index].moving_sphere::hit(r, t_min, t_max, rec);
+        case primitive_type::xy_rect:
+            return xy_rects[p.index].xy_rect::hit(r, t_min, t_max, rec);
+        case primitive_type::xz_rect:
+            return xz_rects[p.index].xz_rect::hit(r, t_min, t_max, rec);
+        case primitive_type::yz_rect:
+            return yz_rects[p.index].yz_rect::hit(r, t_min, t_max, rec);
+        case primitive_type::triangle:
+            return triangles[p.index].intersect(r, t_min, t_max, rec);
+        default:
+            return others[p.index]->hit(r, t_min, t_max, rec);
+        }
+    }
+
+    RTW_FORCE_INLINE bool hit_any_primitive(primitive_ref p, const ray &r, double t_min, double t_max) const
+    {
+        switch (p.type)
+        {
+        case primitive_type::sphere:
+            return spheres[p.index].occluded(r, t_min, t_max);
+        case primitive_type::moving_sphere:
+            return moving_spheres[p.index].moving_sphere::hit_any(r, t_min, t_max);
+        case primitive_type::xy_rect:
+            return xy_rects[p.index].xy_rect::hit_any(r, t_min, t_max);
+        case primitive_type::xz_rect:
+            return xz_rects[p.index].xz_rect::hit_any(r, t_min, t_max);
+        case primitive_type::yz_rect:
+            return yz_rects[p.index].yz_rect::hit_any(r, t_min, t_max);
+        case primitive_type::triangle:
+            return triangles[p.index].occluded(r, t_min, t_max);
+        default:
+            return others[p.index]->hit_any(r, t_min, t_max);
+        }
+    }
+
+    /**
+     * @brief 把物体复制到对应类型的数组中，并记录其下标和包围盒
+     */
+    template <typename T>
+    static void append(std::vector<T> &objects, primitive_type type, const T &object,
+                       double time0, double time1, std::vector<primitive_ref> &refs, std::vector<aabb> &bounds)
+    {
+        aabb object_box;
+        if (!object.bounding_box(time0, time1, object_box))
+            std::cerr << "No bounding box in compiled_scene constructor.\n";
+
+        refs.push_back({type, static_cast<uint32_t>(objects.size())});
+        bounds.push_back(object_box);
+        objects.push_back(object);
+    }
+
+    void add(const shared_ptr<hittable> &object, double time0, double time1,
+             std::vector<primitive_ref> &refs, std::vector<aabb> &bounds)
+    {
+        // 按实际类型匹配，子类（如 sphere 的派生类）不能按基类复制，需要精确比较类型
+        const auto &type = typeid(*object);
+
+        if (type == typeid(sphere))
+            append(spheres, primitive_type::sphere, static_cast<const sphere &>(*object), time0, time1, refs, bounds);
+        else if (type == typeid(moving_sphere))
+            append(moving_spheres, primitive_type::moving_sphere, static_cast<const moving_sphere &>(*object), time0, time1, refs, bounds);
+        else if (type == typeid(xy_rect))
+            append(xy_rects, primitive_type::xy_rect, static_cast<const xy_rect &>(*object), time0, time1, refs, bounds);
+        else if (type == typeid(xz_rect))
+            append(xz_rects, primitive_type::xz_rect, static_cast<const xz_rect &>(*object), time0, time1, refs, bounds);
+        else if (type == typeid(yz_rect))
+            append(yz_rects, primitive_type::yz_rect, static_cast<const yz_rect &>(*object), time0, time1, refs, bounds);
+        else if (type == typeid(triangle))
+            append(triangles, primitive_type::triangle, static_cast<const triangle &>(*object), time0, time1, refs, bounds);
+        else if (type == typeid(::box))
+        {
+            for (const auto &side : static_cast<const ::box &>(*object).sides.objects)
+                add(side, time0, time1, refs, bounds);
+        }
+        else if (type == typeid(hittable_list))
+        {
+            for (const auto &child : static_cast<const hittable_list &>(*object).objects)
+                add(child, time0, time1, refs, bounds);
+        }
+        else
+        {
+            aabb object_box;
+            if (!object->bounding_box(time0, time1, object_box))
+                std::cerr << "No bounding box in compiled_scene constructor.\n";
+
+            refs.push_back({primitive_type::other, static_cast<uint32_t>(others.size())});
+            bounds.push_back(object_box);
+            others.push_back(object);
+        }
+    }
+};
+
+#endif
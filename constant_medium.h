@@ -82,7 +82,7 @@ bool constant_medium::hit(const ray &r, double t_min, double t_max, hit_record &
 
     rec.normal = vec3(1, 0, 0); // 随机取值
     rec.front_face = true;      // 随机取值
-    rec.mat = phase_function;
+    rec.mat = phase_function.get();
 
     return true;
 }
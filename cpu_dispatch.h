@@ -0,0 +1,48 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+/**
+ * 运行时按 CPU 支持的指令集选择函数实现
+ *
+ * 标记了 RTW_MULTIVERSION 的函数会分别以 AVX-512、AVX2、SSE4.2 和默认指令集编译多份，
+ * 程序加载时根据 CPUID 选择当前 CPU 支持的最快版本，因此同一个可执行文件可以在不同的
+ * 机器上使用各自最合适的指令集；不支持 target_clones 的编译器（MSVC、Clang 等）上该宏为空
+ * 定义 RTW_NO_MULTIVERSION 可以关闭运行时选择，只按编译选项指定的指令集生成一份代码
+ *
+ * 只应标记遍历循环这类粗粒度的函数：多版本函数不能被内联，求交、包围盒测试等小函数标记为
+ * RTW_FORCE_INLINE，保证内联到调用它们的多版本函数中并按同样的指令集编译（GCC 按大小判断是否内联时，
+ * 不会把较大的默认指令集函数内联到指定了指令集的函数中）。虚函数不能使用多版本，
+ * 需要由虚函数转发给标记了 RTW_MULTIVERSION 的非虚函数
+ *
+ * GCC 默认会把乘加合并为 FMA 指令，多版本函数在支持 FMA 的 CPU 上会因此得到与其它 CPU 不同的结果，
+ * 因此只在这些函数中关闭合并，使所有指令集版本的渲染结果逐位相同；其余代码按默认指令集编译，本来就不会生成 FMA
+ */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__ELF__) && !defined(RTW_NO_MULTIVERSION)
+#define RTW_HAS_MULTIVERSION
+#define RTW_MULTIVERSION __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default"), optimize("fp-contract=off")))
+#define RTW_FORCE_INLINE __attribute__((always_inline))
+#else
+#define RTW_MULTIVERSION
+#define RTW_FORCE_INLINE
+#endif
+
+/**
+ * @brief 返回 RTW_MULTIVERSION 函数在当前 CPU 上实际使用的指令集，选择顺序与 target_clones 相同
+ */
+inline const char *active_isa()
+{
+#ifdef RTW_HAS_MULTIVERSION
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512f";
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    if (__builtin_cpu_supports("sse4.2"))
+        return "sse4.2";
+    return "default";
+#else
+    return "default (no runtime dispatch)";
+#endif
+}
+
+#endif
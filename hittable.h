@@ -8,17 +8,18 @@
 class material;
 
 /**
- * @brief 物体表面与射线相交点的属性
+ * @brief 物体表面与射线相交点的属性；T 为标量类型，项目中通过 hit_record 使用
  */
-struct hit_record
+template <typename T>
+struct hit_record_t
 {
-    point3 p;                 // 坐标
-    vec3 normal;              // 法线
-    double t;                 // 时间；射线从发射点出发，沿着指定方向经过 t 时间到达物体表面
-    double u;                 // 纹理坐标
-    double v;                 // 纹理坐标
+    vec3_t<T> p;              // 坐标
+    vec3_t<T> normal;         // 法线
+    T t;                      // 时间；射线从发射点出发，沿着指定方向经过 t 时间到达物体表面
+    T u;                      // 纹理坐标
+    T v;                      // 纹理坐标
     bool front_face;          // 是正面还是背面
-    shared_ptr<material> mat; // 材质
+    const material *mat;      // 材质；由场景中的物体持有，这里只保存指针，避免每次求交时修改引用计数
 
     /**
      * @brief 一个点可以有两条法线，一条垂直于物体正面，一条垂直于物体背面；
@@ -28,13 +29,15 @@ struct hit_record
      * @param r 射线
      * @param outward_normal 物体表面法线
      */
-    inline void set_face_normal(const ray &r, const vec3 &outward_normal)
+    RTW_FORCE_INLINE void set_face_normal(const ray_t<T> &r, const vec3_t<T> &outward_normal)
     {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
 };
 
+using hit_record = hit_record_t<real>;
+
 /**
  * @brief 所有可与射线交互物体的基类
  */
@@ -51,6 +54,18 @@ public:
      */
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const = 0;
 
+    /**
+     * @brief 只判断在指定时间范围内射线是否与物体相交，不计算交点的属性；
+     * 加速结构在找到第一个交点后立即返回，不需要寻找最近的交点
+     *
+     * 默认实现调用 hit，子类应当提供更快的实现
+     */
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const
+    {
+        hit_record rec;
+        return hit(r, t_min, t_max, rec);
+    }
+
     /**
      * @brief 为物体生成包围盒
      *
@@ -71,8 +86,55 @@ public:
     {
         return vec3(1, 0, 0);
     }
+
+    /**
+     * @brief 作为光源时从 origin 采样光源上的一点，用于计算直接光照；方向的分布与 random 相同
+     *
+     * @param to_light 从 origin 指向采样点的射线
+     * @param rec 光源自身在采样点的交点记录，rec.t 为采样点在 to_light 上的距离，rec.mat 用于计算辐射亮度
+     * @return 采样的方向击中光源时返回 true
+     */
+    virtual bool sample_point(const point3 &origin, double time, ray &to_light, hit_record &rec) const
+    {
+        to_light = ray(origin, random(origin), time);
+        return hit(to_light, 0.001, infinity, rec);
+    }
+
+    /**
+     * @brief 作为光源时的功率估计（材质平均辐射亮度的亮度值 × 表面积），用于按功率选择光源；
+     * 不发光或无法估计时返回 0
+     */
+    virtual double power() const
+    {
+        return 0.0;
+    }
+
+    /**
+     * @brief 作为光源时表面法线的范围：中心方向 w，法线与 w 的最大夹角的余弦 cos_theta_o；
+     * two_sided 表示正反两面都可能发光；默认法线可以朝向任意方向（如球体）
+     */
+    virtual void emission_cone(vec3 &w, double &cos_theta_o, bool &two_sided) const
+    {
+        w = vec3(0, 0, 1);
+        cos_theta_o = -1;
+        two_sided = false;
+    }
 };
 
+// 当前线程中以 any_hit_query 代替完整的最近交点查询的次数，由渲染器在每个 tile 结束时汇总
+inline thread_local uint64_t thread_saved_closest_hit_count = 0;
+
+/**
+ * @brief 代替最近交点查询的可见性查询：调用处原本用 hit 求最近交点、却只用到是否相交
+ * （光源的 pdf_value 和 MIS 的阴影射线），改为调用 hit_any 并计入 thread_saved_closest_hit_count；
+ * 本来就只需要判断是否相交的查询直接调用 hit_any，不计数
+ */
+inline bool any_hit_query(const hittable &object, const ray &r, double t_min, double t_max)
+{
+    thread_saved_closest_hit_count++;
+    return object.hit_any(r, t_min, t_max);
+}
+
 /**
  * @brief 表示一个经过位移的物体
  */
@@ -90,6 +152,11 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return object->hit_any(ray(r.origin() - offset, r.direction(), r.time()), t_min, t_max);
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override;
 };
 
@@ -165,16 +232,7 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
     {
-        auto origin = r.origin();
-        auto direction = r.direction();
-
-        origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
-        origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
-
-        direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
-        direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
-
-        ray rotated_r(origin, direction, r.time());
+        ray rotated_r = rotate_ray(r);
 
         if (!object->hit(rotated_r, t_min, t_max, rec))
             return false;
@@ -194,6 +252,11 @@ public:
         return true;
     }
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return object->hit_any(rotate_ray(r), t_min, t_max);
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         output_box = bounds;
@@ -201,6 +264,23 @@ public:
     }
 
 private:
+    /**
+     * @brief 物体旋转 angle 度，相当于射线反向旋转
+     */
+    ray rotate_ray(const ray &r) const
+    {
+        auto origin = r.origin();
+        auto direction = r.direction();
+
+        origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
+        origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
+
+        direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
+        direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
+
+        return ray(origin, direction, r.time());
+    }
+
     shared_ptr<hittable> object;
     double sin_theta;
     double cos_theta;
@@ -229,10 +309,36 @@ public:
         return true;
     }
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return object->hit_any(r, t_min, t_max);
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         return object->bounding_box(time0, time1, output_box);
     }
+
+    virtual double pdf_value(const point3 &origin, const vec3 &direction) const override
+    {
+        return object->pdf_value(origin, direction);
+    }
+
+    virtual vec3 random(const vec3 &origin) const override
+    {
+        return object->random(origin);
+    }
+
+    virtual double power() const override
+    {
+        return object->power();
+    }
+
+    virtual void emission_cone(vec3 &w, double &cos_theta_o, bool &two_sided) const override
+    {
+        object->emission_cone(w, cos_theta_o, two_sided);
+        w = -w;
+    }
 };
 
 #endif
@@ -21,6 +21,17 @@ public:
     virtual bool hit(
         const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        for (const auto &object : objects)
+        {
+            if (object->hit_any(r, t_min, t_max))
+                return true;
+        }
+
+        return false;
+    }
+
     virtual bool bounding_box(
         double time0, double time1, aabb &output_box) const override;
 
@@ -41,23 +52,28 @@ public:
         return objects[random_int(0, int_size - 1)]->random(o);
     }
 
+    bool sample_point(const point3 &o, double time, ray &to_light, hit_record &rec) const override
+    {
+        auto int_size = static_cast<int>(objects.size());
+        return objects[random_int(0, int_size - 1)]->sample_point(o, time, to_light, rec);
+    }
+
 public:
     std::vector<shared_ptr<hittable>> objects;
 };
 
 bool hittable_list::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
 {
-    hit_record temp_rec;
+    // 物体只在击中时写入 rec，且只会击中比 closest_so_far 更近的交点，因此可以直接写入 rec
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
     for (const auto &object : objects)
     {
-        if (object->hit(r, t_min, closest_so_far, temp_rec))
+        if (object->hit(r, t_min, closest_so_far, rec))
         {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
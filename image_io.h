@@ -0,0 +1,378 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "rtweekend.h"
+
+/**
+ * @brief 由 count 个采样之和得到像素的平均值，NaN 视为 0；count 为 0 时返回黑色
+ */
+inline color average_pixel(const color &sum, int count)
+{
+    color result(0, 0, 0);
+    if (count <= 0)
+        return result;
+
+    for (int c = 0; c < 3; c++)
+    {
+        auto value = sum[c];
+        result[c] = value != value ? 0 : value / count;
+    }
+
+    return result;
+}
+
+/**
+ * @brief 将累加了 samples_per_pixel 个采样的 frame buffer 转换为每个像素的平均值，NaN 视为 0
+ */
+inline std::vector<color> average_samples(const std::vector<color> &frame_buffer, int samples_per_pixel)
+{
+    std::vector<color> image(frame_buffer.size());
+    for (size_t i = 0; i < frame_buffer.size(); i++)
+        image[i] = average_pixel(frame_buffer[i], samples_per_pixel);
+
+    return image;
+}
+
+/**
+ * @brief 把一个像素转换为 P6 中的 3 个字节：与 write_color 相同，对线性颜色做伽马 2 校正并截断到 8 位
+ */
+inline void encode_ppm_pixel(const color &pixel, uint8_t *out)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        double value = pixel[c];
+        value = value != value ? 0.0 : sqrt(value);
+        out[c] = static_cast<uint8_t>(256 * clamp(value, 0.0, 0.999));
+    }
+}
+
+/**
+ * @brief 以二进制 PPM（P6）格式保存图像，整幅图像先转换到连续的缓冲区中再一次写入
+ *
+ * @param image 按从上到下、从左到右的顺序排列的像素（线性颜色，已经取过平均）
+ * @return 写入成功时返回 true
+ */
+inline bool write_ppm(const std::string &filename, const std::vector<color> &image, int width, int height)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    file << "P6\n"
+         << width << ' ' << height << "\n255\n";
+
+    std::vector<uint8_t> pixels(image.size() * 3);
+    for (size_t i = 0; i < image.size(); i++)
+        encode_ppm_pixel(image[i], &pixels[i * 3]);
+
+    file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief 以 PFM 格式（线性的 32 位浮点 RGB，小端）保存图像
+ *
+ * @param image 按从上到下、从左到右的顺序排列的像素
+ * @return 写入成功时返回 true
+ */
+inline bool write_pfm(const std::string &filename, const std::vector<color> &image, int width, int height)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    // 负的比例因子表示小端
+    file << "PF\n"
+         << width << ' ' << height << "\n-1.0\n";
+
+    // PFM 从最下面一行开始存放
+    std::vector<float> row(width * 3);
+    for (int j = height - 1; j >= 0; j--)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            for (int c = 0; c < 3; c++)
+                row[i * 3 + c] = static_cast<float>(image[j * width + i][c]);
+        }
+        file.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(float));
+    }
+
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief 把单精度浮点数转换为半精度（IEEE 754 binary16）的位表示，就近舍入到偶数；
+ * 超出半精度范围的值变为无穷大，过小的值变为非规格化数或 0，NaN 保持为 NaN
+ */
+inline uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    uint32_t exponent = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    // 无穷大和 NaN
+    if (exponent == 0xff)
+        return sign | 0x7c00u | (mantissa ? 0x200u : 0);
+
+    int half_exponent = static_cast<int>(exponent) - 127 + 15;
+
+    // 溢出
+    if (half_exponent >= 0x1f)
+        return sign | 0x7c00u;
+
+    // 非规格化数：把隐含的 1 加回尾数后右移
+    if (half_exponent <= 0)
+    {
+        if (half_exponent < -10)
+            return sign;
+
+        mantissa |= 0x800000u;
+        int shift = 14 - half_exponent;
+        uint32_t half_mantissa = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half_mantissa & 1)))
+            half_mantissa++;
+
+        return sign | static_cast<uint16_t>(half_mantissa);
+    }
+
+    // 规格化数；尾数进位到指数时结果仍然正确，最大的有限值进位后变为无穷大
+    uint32_t half = (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1)))
+        half++;
+
+    return sign | static_cast<uint16_t>(half);
+}
+
+/**
+ * @brief OpenEXR 中通道的数据类型，数值与文件格式中的定义相同
+ */
+enum class exr_pixel_type : int32_t
+{
+    half = 1,
+    single = 2,
+};
+
+/**
+ * @brief OpenEXR 中按通道名称排序（B、G、R）后各通道在 color 中的下标
+ */
+constexpr int exr_channel_index[] = {2, 1, 0};
+
+/**
+ * @brief 在 buffer 末尾追加不压缩的 RGB OpenEXR 文件的标识、版本号和文件头（以空字节结束），
+ * 之后紧接着的是偏移量表
+ *
+ * @param tile_size 大于 0 时为按 tile_size × tile_size 的 tile 存储的单层文件，否则为每个数据块一行的逐行存储
+ */
+inline void append_exr_header(std::vector<char> &buffer, int width, int height, exr_pixel_type type, int tile_size = 0)
+{
+    auto put = [&](const void *data, size_t size)
+    {
+        auto bytes = static_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    };
+    auto put_i32 = [&](int32_t x)
+    { put(&x, sizeof(x)); };
+    auto put_string = [&](const std::string &text)
+    { put(text.c_str(), text.size() + 1); };
+    auto attribute = [&](const std::string &name, const std::string &type_name, int32_t size)
+    {
+        put_string(name);
+        put_string(type_name);
+        put_i32(size);
+    };
+
+    // 标识和版本号（2，第 9 位表示单部分的 tile 存储）
+    const unsigned char magic[] = {0x76, 0x2f, 0x31, 0x01, 2, static_cast<unsigned char>(tile_size > 0 ? 2 : 0), 0, 0};
+    put(magic, sizeof(magic));
+
+    // 通道列表：名称、数据类型、pLinear 与 3 个保留字节、x 和 y 方向的采样间隔，最后以空字节结束
+    attribute("channels", "chlist", 3 * (2 + 16) + 1);
+    for (auto name : {"B", "G", "R"})
+    {
+        put_string(name);
+        put_i32(static_cast<int32_t>(type));
+        put_i32(0);
+        put_i32(1);
+        put_i32(1);
+    }
+    buffer.push_back(0);
+
+    attribute("compression", "compression", 1);
+    buffer.push_back(0); // NO_COMPRESSION
+
+    for (auto name : {"dataWindow", "displayWindow"})
+    {
+        attribute(name, "box2i", 16);
+        put_i32(0);
+        put_i32(0);
+        put_i32(width - 1);
+        put_i32(height - 1);
+    }
+
+    attribute("lineOrder", "lineOrder", 1);
+    buffer.push_back(0); // INCREASING_Y
+
+    float one = 1, zero = 0;
+    attribute("pixelAspectRatio", "float", 4);
+    put(&one, 4);
+
+    attribute("screenWindowCenter", "v2f", 8);
+    put(&zero, 4);
+    put(&zero, 4);
+
+    attribute("screenWindowWidth", "float", 4);
+    put(&one, 4);
+
+    if (tile_size > 0)
+    {
+        // tile 的宽、高和模式（ONE_LEVEL）
+        attribute("tiles", "tiledesc", 9);
+        put_i32(tile_size);
+        put_i32(tile_size);
+        buffer.push_back(0);
+    }
+
+    buffer.push_back(0); // 文件头结束
+}
+
+/**
+ * @brief 把一个通道的值按 type 写入 out，返回写入的字节数
+ */
+inline int encode_exr_value(double value, exr_pixel_type type, char *out)
+{
+    float single = static_cast<float>(value);
+    if (type == exr_pixel_type::half)
+    {
+        uint16_t half = float_to_half(single);
+        std::memcpy(out, &half, sizeof(half));
+        return sizeof(half);
+    }
+
+    std::memcpy(out, &single, sizeof(single));
+    return sizeof(single);
+}
+
+/**
+ * @brief 以 OpenEXR 格式保存线性的 RGB 图像；只实现了不压缩的逐行（scanline）存储，
+ * 每个数据块只包含一行，足以被 OpenEXR 及兼容的软件读取，保留超过 1 的高动态范围数据供色调映射使用
+ *
+ * 文件由标识和版本号、属性组成的文件头、每一行数据的偏移量表以及各行数据组成；
+ * 每一行数据依次为行号、数据长度和按通道名称排序（B、G、R）的各通道的所有像素。
+ * 整个文件先在内存中组装好再一次写入
+ *
+ * @param image 按从上到下、从左到右的顺序排列的像素（线性颜色，已经取过平均）
+ * @param type half 时每个通道 16 位，single 时每个通道 32 位
+ * @return 写入成功时返回 true
+ */
+inline bool write_exr(const std::string &filename, const std::vector<color> &image, int width, int height,
+                      exr_pixel_type type = exr_pixel_type::half)
+{
+    std::vector<char> buffer;
+    append_exr_header(buffer, width, height, type);
+
+    // 偏移量表，之后每一行数据的长度都相同
+    int channel_size = type == exr_pixel_type::half ? 2 : 4;
+    int32_t line_size = width * 3 * channel_size;
+    uint64_t offset = buffer.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    for (int y = 0; y < height; y++)
+    {
+        auto bytes = reinterpret_cast<const char *>(&offset);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(offset));
+        offset += 8 + line_size;
+    }
+
+    // 像素数据直接写入预先分配好的缓冲区
+    size_t position = buffer.size();
+    buffer.resize(position + static_cast<size_t>(height) * (8 + line_size));
+    for (int y = 0; y < height; y++)
+    {
+        std::memcpy(&buffer[position], &y, 4);
+        std::memcpy(&buffer[position + 4], &line_size, 4);
+        position += 8;
+
+        for (int c : exr_channel_index)
+        {
+            for (int x = 0; x < width; x++)
+                position += encode_exr_value(image[y * width + x][c], type, &buffer[position]);
+        }
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    file.write(buffer.data(), buffer.size());
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief 以 8 位灰度 PGM 格式保存每个像素的采样数，max_samples 对应白色，用于检查自适应采样把采样分配到了哪里
+ *
+ * @param counts 按从上到下、从左到右的顺序排列的采样数
+ * @return 写入成功时返回 true
+ */
+inline bool write_sample_map(const std::string &filename, const std::vector<int> &counts, int width, int height,
+                             int max_samples)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    file << "P5\n"
+         << width << ' ' << height << "\n255\n";
+
+    std::vector<uint8_t> pixels(counts.size());
+    for (size_t i = 0; i < counts.size(); i++)
+        pixels[i] = static_cast<uint8_t>(255.0 * std::min(counts[i], max_samples) / std::max(max_samples, 1) + 0.5);
+
+    file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief 读取 write_pfm 保存的 PFM 图像
+ *
+ * @return 读取成功时返回 true，image 按从上到下、从左到右的顺序排列
+ */
+inline bool read_pfm(const std::string &filename, std::vector<color> &image, int &width, int &height)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::string type;
+    double scale;
+    file >> type >> width >> height >> scale;
+    file.get();
+
+    if (type != "PF" || width <= 0 || height <= 0 || scale >= 0)
+        return false;
+
+    image.assign(width * height, color(0));
+    std::vector<float> row(width * 3);
+    for (int j = height - 1; j >= 0; j--)
+    {
+        if (!file.read(reinterpret_cast<char *>(row.data()), row.size() * sizeof(float)))
+            return false;
+
+        for (int i = 0; i < width; i++)
+            image[j * width + i] = color(row[i * 3], row[i * 3 + 1], row[i * 3 + 2]);
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "transform.h"
+
+/**
+ * @brief 两级加速结构中的实例；多个实例共享同一个底层加速结构（BLAS，如 mesh），
+ * 每个实例只保存一个仿射变换和变换后的包围盒，因此内存随实例数量而不是三角形数量增长
+ *
+ * 场景的顶层 bvh（scene_generator::generate_bvh_scene）在实例的包围盒上构建，即顶层加速结构（TLAS）
+ *
+ * 求交时把射线变换到物体空间，不对方向归一化，因此物体空间与世界空间的 t 相同
+ */
+class instance : public hittable
+{
+public:
+    instance() {}
+
+    /**
+     * @param blas 被实例化的物体，通常是构建好 bvh 的 mesh
+     * @param object_to_world 物体空间到世界空间的变换
+     * @param mat 不为空时替换 blas 返回的材质
+     */
+    instance(shared_ptr<hittable> blas, const affine_transform &object_to_world, shared_ptr<material> mat = nullptr)
+        : blas(blas), object_to_world(object_to_world), world_to_object(object_to_world.inverse()), mat(mat)
+    {
+        aabb object_box;
+        has_box = blas->bounding_box(0, 1, object_box);
+        if (has_box)
+            box = object_to_world.box(object_box);
+    }
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        ray object_r(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+
+        if (!blas->hit(object_r, t_min, t_max, rec))
+            return false;
+
+        rec.p = object_to_world.point(rec.p);
+
+        // 法线按逆变换的转置变换；物体空间的法线已经朝向射线一侧，这里重新按外法线计算正反面
+        auto object_normal = rec.front_face ? rec.normal : -rec.normal;
+        rec.set_face_normal(r, unit_vector(world_to_object.transposed_vector(object_normal)));
+
+        if (mat)
+            rec.mat = mat.get();
+
+        return true;
+    }
+
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return blas->hit_any(ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time()), t_min, t_max);
+    }
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = box;
+        return has_box;
+    }
+
+public:
+    shared_ptr<hittable> blas;
+    affine_transform object_to_world;
+    affine_transform world_to_object;
+    shared_ptr<material> mat;
+    aabb box;
+    bool has_box = false;
+};
+
+#endif
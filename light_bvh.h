@@ -0,0 +1,386 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "bvh.h"
+
+/**
+ * @brief 一个或一组光源的发光范围：包围盒、表面法线的圆锥（中心方向 w，法线与 w 的最大夹角 theta_o）
+ * 和总功率 phi；漫反射光源在法线两侧 90 度以内发光，因此发光方向的范围为 theta_o + 90 度
+ */
+struct light_bounds
+{
+    aabb bounds;
+    vec3 w = vec3(0, 0, 1);
+    double cos_theta_o = 1;
+    double phi = 0;
+    bool two_sided = false;
+
+    /**
+     * @brief 估计这组光源对点 p 的贡献：功率除以距离的平方，再乘以 p 可能位于的发光方向与法线圆锥之间最小夹角的余弦；
+     * 不要求精确，只要求同一组光源对同一个点总是返回相同的值，采样和计算 pdf 时才能得到一致的概率
+     */
+    double importance(const point3 &p) const
+    {
+        if (phi <= 0)
+            return 0;
+
+        auto center = bounds.centroid();
+        auto offset = p - center;
+        auto distance_squared = offset.length_squared();
+        auto radius = 0.5 * (bounds.max() - bounds.min()).length();
+
+        // 点在包围球内时不能确定方向，距离以包围盒大小为下限，避免靠近光源时重要性趋于无穷
+        if (distance_squared <= radius * radius)
+            return phi / fmax(distance_squared, radius);
+
+        auto wi = offset / sqrt(distance_squared);
+        double cos_theta_w = dot(w, wi);
+        if (two_sided)
+            cos_theta_w = fabs(cos_theta_w);
+        double sin_theta_w = safe_sqrt(1 - cos_theta_w * cos_theta_w);
+
+        // 包围球对 p 所张的半角
+        double sin_theta_b = radius / sqrt(distance_squared);
+        double cos_theta_b = safe_sqrt(1 - sin_theta_b * sin_theta_b);
+
+        // cos(max(0, theta_w - theta_o - theta_b))
+        double sin_theta_o = safe_sqrt(1 - cos_theta_o * cos_theta_o);
+        double cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        double sin_theta_x = safe_sqrt(1 - cos_theta_x * cos_theta_x);
+        double cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+        // 超出法线圆锥 90 度以外的方向不会收到光
+        if (cos_theta_p <= 0)
+            return 0;
+
+        return phi * cos_theta_p / fmax(distance_squared, radius);
+    }
+
+    /**
+     * @brief 合并两组光源的发光范围；法线圆锥取能同时包含两者的最小圆锥
+     */
+    friend light_bounds merge(const light_bounds &a, const light_bounds &b)
+    {
+        if (a.phi <= 0)
+            return b;
+        if (b.phi <= 0)
+            return a;
+
+        light_bounds result;
+        result.bounds = surrounding_box(a.bounds, b.bounds);
+        result.phi = a.phi + b.phi;
+        result.two_sided = a.two_sided || b.two_sided;
+        merge_cones(a.w, a.cos_theta_o, b.w, b.cos_theta_o, result.w, result.cos_theta_o);
+
+        return result;
+    }
+
+private:
+    static double safe_sqrt(double x) { return sqrt(fmax(0.0, x)); }
+
+    static double safe_acos(double x) { return acos(fmin(1.0, fmax(-1.0, x))); }
+
+    /**
+     * @brief cos(max(0, a - b))，a、b 以正弦和余弦给出
+     */
+    static double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b)
+    {
+        if (cos_a > cos_b)
+            return 1;
+        return cos_a * cos_b + sin_a * sin_b;
+    }
+
+    static void merge_cones(const vec3 &wa, double cos_a, const vec3 &wb, double cos_b, vec3 &w, double &cos_theta)
+    {
+        // 任意一个圆锥已经覆盖所有方向
+        w = wa;
+        cos_theta = -1;
+        if (cos_a <= -1 || cos_b <= -1)
+            return;
+
+        double theta_a = safe_acos(cos_a);
+        double theta_b = safe_acos(cos_b);
+        double theta_d = safe_acos(dot(wa, wb));
+
+        // 一个圆锥包含另一个
+        if (fmin(theta_d + theta_b, pi) <= theta_a)
+        {
+            w = wa;
+            cos_theta = cos_a;
+            return;
+        }
+        if (fmin(theta_d + theta_a, pi) <= theta_b)
+        {
+            w = wb;
+            cos_theta = cos_b;
+            return;
+        }
+
+        double theta_o = (theta_a + theta_d + theta_b) / 2;
+        auto axis = cross(wa, wb);
+        if (theta_o >= pi || axis.length_squared() < 1e-12)
+            return;
+
+        // 把 wa 绕 axis 向 wb 旋转 theta_o - theta_a（Rodrigues 公式）
+        axis = unit_vector(axis);
+        double theta_r = theta_o - theta_a;
+        w = unit_vector(cos(theta_r) * wa + sin(theta_r) * cross(axis, wa) + (1 - cos(theta_r)) * dot(axis, wa) * axis);
+        cos_theta = cos(theta_o);
+    }
+};
+
+/**
+ * @brief 光源 bvh 的节点；节点按深度优先顺序连续存放，内部节点的第一个子节点紧跟在自身之后，
+ * second_child 为第二个子节点的下标；叶节点的 first、count 为 lights 中的下标范围
+ */
+struct light_bvh_node
+{
+    light_bounds bounds;
+    aabb box; // 子树中所有光源（包括功率为 0 的光源）的包围盒，计算 pdf 时用于与射线求交
+    uint32_t second_child = 0;
+    uint32_t parent = 0;
+    uint32_t first = 0;
+    uint32_t count = 0; // 为 0 时表示内部节点
+
+    bool is_leaf() const { return count > 0; }
+};
+
+/**
+ * @brief 光源 bvh，用于大量光源的场景；每个节点保存子树中光源的包围盒、法线圆锥和总功率，
+ * 选择光源时从根节点出发，按两个子节点对着色点的重要性随机选择一个子节点，直到叶节点，
+ * 因此选择和计算某个光源被选中的概率都只需要 O(log N)
+ *
+ * pdf_value 只对射线经过其包围盒的光源计算 pdf，每个被击中的光源再沿父节点回溯计算被选中的概率，
+ * 不需要像 hittable_list 那样遍历所有光源
+ */
+class light_bvh : public hittable
+{
+public:
+    light_bvh() {}
+
+    explicit light_bvh(const hittable_list &light_list)
+    {
+        auto count = light_list.objects.size();
+        if (count == 0)
+            return;
+
+        std::vector<light_bounds> bounds(count);
+        std::vector<aabb> boxes(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto &light = light_list.objects[i];
+            light->bounding_box(0, 1, bounds[i].bounds);
+            light->emission_cone(bounds[i].w, bounds[i].cos_theta_o, bounds[i].two_sided);
+            bounds[i].phi = light->power();
+            boxes[i] = bounds[i].bounds;
+        }
+
+        // 每个叶节点只放一个光源，使选择完全由重要性决定；包围盒完全相同的光源仍可能在同一个叶节点中
+        bvh_build_options options;
+        options.max_leaf_size = 1;
+        bvh_builder builder(std::move(boxes), options);
+        auto root = builder.build();
+
+        for (auto index : builder.ordered_indices)
+        {
+            lights.add(light_list.objects[index]);
+            light_info.push_back(bounds[index]);
+        }
+
+        light_leaf.resize(count);
+        flatten(*root, 0);
+    }
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        return lights.hit(r, t_min, t_max, rec);
+    }
+
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return lights.hit_any(r, t_min, t_max);
+    }
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        return lights.bounding_box(time0, time1, output_box);
+    }
+
+    virtual double pdf_value(const point3 &o, const vec3 &v) const override
+    {
+        if (nodes.empty())
+            return 0;
+
+        // 光源 bvh 由 bvh_builder 构建，深度不超过 bvh_max_depth，栈中最多保存路径上每一层的另一个子节点
+        ray r(o, v);
+        uint32_t stack[bvh_max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+        double sum = 0;
+
+        while (true)
+        {
+            const auto &node = nodes[current];
+
+            if (node.box.hit(r, 0.001, infinity))
+            {
+                if (node.is_leaf())
+                {
+                    for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    {
+                        auto pdf = lights.objects[i]->pdf_value(o, v);
+                        if (pdf > 0)
+                            sum += pmf(o, i) * pdf;
+                    }
+                }
+                else
+                {
+                    stack[stack_size++] = node.second_child;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+
+            current = stack[--stack_size];
+        }
+
+        return sum;
+    }
+
+    virtual vec3 random(const vec3 &o) const override
+    {
+        return lights.objects[select(o)]->random(o);
+    }
+
+    virtual bool sample_point(const point3 &o, double time, ray &to_light, hit_record &rec) const override
+    {
+        return lights.objects[select(o)]->sample_point(o, time, to_light, rec);
+    }
+
+    /**
+     * @brief 着色点 o 处选中第 i 个光源（lights 中的下标）的概率
+     */
+    double pmf(const point3 &o, uint32_t i) const
+    {
+        uint32_t current = light_leaf[i];
+        const auto &leaf = nodes[current];
+
+        double p = 1;
+        if (leaf.count > 1)
+        {
+            double total = leaf_importance(o, leaf);
+            p = total > 0 ? light_info[i].importance(o) / total : 1.0 / leaf.count;
+        }
+
+        while (current != 0)
+        {
+            uint32_t parent = nodes[current].parent;
+            double first = child_probability(o, parent, parent + 1);
+            p *= current == parent + 1 ? first : 1 - first;
+            current = parent;
+        }
+
+        return p;
+    }
+
+public:
+    hittable_list lights;                 // 按叶节点顺序排列的光源
+    std::vector<light_bounds> light_info; // 每个光源的发光范围
+    std::vector<uint32_t> light_leaf;     // 每个光源所在的叶节点
+    std::vector<light_bvh_node> nodes;
+
+private:
+    /**
+     * @brief 从着色点 o 出发，按子节点的重要性自顶向下选择一个光源，返回其在 lights 中的下标
+     */
+    uint32_t select(const point3 &o) const
+    {
+        uint32_t current = 0;
+        while (!nodes[current].is_leaf())
+        {
+            double p = child_probability(o, current, current + 1);
+            current = random_double() < p ? current + 1 : nodes[current].second_child;
+        }
+
+        const auto &leaf = nodes[current];
+        uint32_t light = leaf.first;
+        if (leaf.count > 1)
+        {
+            // 叶节点中有多个光源时按各自的重要性选择，重要性都为 0 时均匀选择
+            double total = leaf_importance(o, leaf);
+            double u = random_double() * (total > 0 ? total : leaf.count);
+            for (light = leaf.first; light + 1 < leaf.first + leaf.count; light++)
+            {
+                u -= total > 0 ? light_info[light].importance(o) : 1;
+                if (u < 0)
+                    break;
+            }
+        }
+
+        return light;
+    }
+
+    /**
+     * @brief 在 node 处选择第一个子节点 first 的概率；两个子节点的重要性都为 0 时各取一半
+     */
+    double child_probability(const point3 &o, uint32_t node, uint32_t first) const
+    {
+        double a = nodes[first].bounds.importance(o);
+        double b = nodes[nodes[node].second_child].bounds.importance(o);
+        return a + b > 0 ? a / (a + b) : 0.5;
+    }
+
+    double leaf_importance(const point3 &o, const light_bvh_node &leaf) const
+    {
+        double total = 0;
+        for (uint32_t i = leaf.first; i < leaf.first + leaf.count; i++)
+            total += light_info[i].importance(o);
+        return total;
+    }
+
+    uint32_t flatten(const bvh_build_node &build_node, uint32_t parent, int depth = 1)
+    {
+        assert(depth <= bvh_max_depth && "bvh_builder limits the tree depth");
+
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        light_bvh_node node;
+        node.parent = parent;
+        node.box = build_node.bounds;
+
+        if (build_node.is_leaf())
+        {
+            node.first = build_node.first;
+            node.count = build_node.count;
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                node.bounds = merge(node.bounds, light_info[i]);
+                light_leaf[i] = index;
+            }
+        }
+        else
+        {
+            flatten(*build_node.children[0], index, depth + 1);
+            node.second_child = flatten(*build_node.children[1], index, depth + 1);
+            node.bounds = merge(nodes[index + 1].bounds, nodes[node.second_child].bounds);
+        }
+
+        nodes[index] = node;
+        return index;
+    }
+};
+
+#endif
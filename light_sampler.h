@@ -0,0 +1,167 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+
+/**
+ * @brief 别名表（Walker/Vose alias method）；按给定的权重构建，之后每次采样只需要一个随机数，
+ * 时间复杂度为 O(1)
+ */
+class alias_table
+{
+public:
+    alias_table() {}
+
+    /**
+     * @param weights 每一项的权重，不要求归一化；权重全为 0 时按均匀分布采样
+     */
+    explicit alias_table(const std::vector<double> &weights)
+    {
+        int n = static_cast<int>(weights.size());
+        if (n == 0)
+            return;
+
+        double sum = 0;
+        for (auto w : weights)
+            sum += w;
+
+        pmfs.resize(n);
+        for (int i = 0; i < n; i++)
+            pmfs[i] = sum > 0 ? weights[i] / sum : 1.0 / n;
+
+        // 每一列的高度为 1，概率不足 1 的列由概率多于 1 的列补齐
+        probability.assign(n, 1.0);
+        alias.resize(n);
+        for (int i = 0; i < n; i++)
+            alias[i] = i;
+
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (int i = 0; i < n; i++)
+        {
+            scaled[i] = pmfs[i] * n;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+
+            probability[s] = scaled[s];
+            alias[s] = l;
+
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        // 剩余的列由于舍入误差不严格等于 1，直接视为 1
+        for (auto i : small)
+            probability[i] = 1.0;
+        for (auto i : large)
+            probability[i] = 1.0;
+    }
+
+    bool empty() const { return pmfs.empty(); }
+
+    int size() const { return static_cast<int>(pmfs.size()); }
+
+    /**
+     * @brief 选中第 i 项的概率
+     */
+    double pmf(int i) const { return pmfs[i]; }
+
+    /**
+     * @brief 用一个 [0, 1) 内的随机数采样：整数部分选择列，小数部分决定取该列本身还是其别名
+     */
+    int sample(double u) const
+    {
+        int n = size();
+        double x = u * n;
+        int i = static_cast<int>(x);
+        if (i >= n)
+            i = n - 1;
+
+        return x - i < probability[i] ? i : alias[i];
+    }
+
+public:
+    std::vector<double> probability; // 每一列取自身的概率
+    std::vector<int> alias;          // 每一列的别名
+    std::vector<double> pmfs;        // 归一化后每一项的概率
+};
+
+/**
+ * @brief 按功率选择光源的光源集合；在渲染开始时根据每个光源的 power()（辐射亮度 × 面积）
+ * 构建别名表，random 以 O(1) 的时间按功率选择一个光源，pdf_value 按相同的概率对各光源的 pdf 加权
+ *
+ * 所有光源的功率都为 0（例如光源列表使用的材质不发光）时退化为均匀选择，与 hittable_list 相同
+ */
+class light_sampler : public hittable
+{
+public:
+    light_sampler() {}
+
+    explicit light_sampler(const hittable_list &lights) : lights(lights)
+    {
+        std::vector<double> weights;
+        weights.reserve(lights.objects.size());
+        for (const auto &light : lights.objects)
+            weights.push_back(light->power());
+
+        table = alias_table(weights);
+    }
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        return lights.hit(r, t_min, t_max, rec);
+    }
+
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return lights.hit_any(r, t_min, t_max);
+    }
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        return lights.bounding_box(time0, time1, output_box);
+    }
+
+    virtual double pdf_value(const point3 &o, const vec3 &v) const override
+    {
+        auto sum = 0.0;
+        for (int i = 0; i < table.size(); i++)
+        {
+            // 不会被选中的光源不需要求交
+            if (table.pmf(i) > 0)
+                sum += table.pmf(i) * lights.objects[i]->pdf_value(o, v);
+        }
+
+        return sum;
+    }
+
+    virtual vec3 random(const vec3 &o) const override
+    {
+        return lights.objects[table.sample(random_double())]->random(o);
+    }
+
+    virtual bool sample_point(const point3 &o, double time, ray &to_light, hit_record &rec) const override
+    {
+        return lights.objects[table.sample(random_double())]->sample_point(o, time, to_light, rec);
+    }
+
+public:
+    hittable_list lights;
+    alias_table table;
+};
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <typeinfo>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "bvh.h"
+#include "sphere.h"
+#include "triangle.h"
+
+/**
+ * @brief 将 double 转换为 float，并保证结果不大于（round_down 为 true）或不小于原值，
+ * 使得 float 包围盒始终包含 double 包围盒
+ */
+inline float conservative_float(double value, bool round_down)
+{
+    float f = static_cast<float>(value);
+    if (round_down && f > value)
+        return std::nextafter(f, -std::numeric_limits<float>::infinity());
+    if (!round_down && f < value)
+        return std::nextafter(f, std::numeric_limits<float>::infinity());
+
+    return f;
+}
+
+/**
+ * @brief 线性 bvh 的节点，32 字节；节点按深度优先顺序连续存放，内部节点的第一个
+ * 子节点紧跟在自身之后，offset 保存第二个子节点的下标；叶节点的 offset 保存第一个
+ * 物体的下标，count 为物体数量
+ */
+struct linear_bvh_node
+{
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset;
+    uint16_t count; // 为 0 时表示内部节点
+    uint8_t axis;   // 内部节点的划分轴，用于决定先访问哪个子节点
+    uint8_t pad;
+
+    bool is_leaf() const { return count > 0; }
+
+    /**
+     * @brief 射线与节点包围盒的相交测试
+     *
+     * @param inv_dir 射线方向各分量的倒数，每条射线只需计算一次
+     */
+    bool hit(const point3 &origin, const vec3 &inv_dir, double t_min, double t_max) const
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            double t0 = (bounds_min[a] - origin[a]) * inv_dir[a];
+            double t1 = (bounds_max[a] - origin[a]) * inv_dir[a];
+
+            if (inv_dir[a] < 0.0)
+                std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+
+            if (t_max < t_min)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should be 32 bytes");
+
+/**
+ * @brief 不含指针的线性 bvh；只保存节点数组，物体由使用者按构建得到的顺序存放，
+ * 叶节点通过下标引用物体，求交时由使用者提供的函数完成
+ */
+class linear_bvh_tree
+{
+public:
+    linear_bvh_tree() {}
+
+    /**
+     * @brief 将构建器生成的树展开为线性数组
+     */
+    explicit linear_bvh_tree(const bvh_build_node *root)
+    {
+        if (root)
+            flatten(*root);
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    /**
+     * @brief 使用固定大小的栈遍历 bvh；内部节点按射线方向的符号先访问较近的子节点，
+     * 每次击中物体后缩小 t_max，从而跳过更远的节点
+     *
+     * @param intersect 形如 bool(uint32_t index, double t_min, double &t_max) 的函数，
+     * 对下标为 index 的物体求交，击中时将 t_max 更新为交点的 t 并返回 true
+     */
+    template <typename F>
+    bool traverse(const ray &r, double t_min, double t_max, F &&intersect) const
+    {
+        return traverse_leaves(r, t_min, t_max, [&](uint32_t first, uint32_t count, double t_min, double &t_max) RTW_FORCE_INLINE
+                               {
+                                   bool hit_anything = false;
+                                   for (uint32_t i = first; i < first + count; i++)
+                                       hit_anything |= intersect(i, t_min, t_max);
+                                   return hit_anything; });
+    }
+
+    /**
+     * @brief 与 traverse 相同，但每个叶节点只调用一次 intersect，便于使用者一次处理叶节点中的全部物体
+     *
+     * @param intersect 形如 bool(uint32_t first, uint32_t count, double t_min, double &t_max) 的函数
+     * @param any_hit 为 true 时在第一次击中后立即返回，用于只判断是否相交的查询
+     *
+     * 遍历循环按指令集生成多个版本，包围盒测试和 intersect 内联到每个版本中
+     */
+    template <typename F>
+    RTW_MULTIVERSION bool traverse_leaves(const ray &r, double t_min, double t_max, F &&intersect, bool any_hit = false) const
+    {
+        if (nodes.empty())
+            return false;
+
+        const point3 origin = r.origin();
+        const vec3 direction = r.direction();
+        const vec3 inv_dir(1.0 / direction.x(), 1.0 / direction.y(), 1.0 / direction.z());
+        const bool dir_is_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+        uint32_t stack[max_stack_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+        bool hit_anything = false;
+
+        while (true)
+        {
+            const auto &node = nodes[current];
+
+            if (node.hit(origin, inv_dir, t_min, t_max))
+            {
+                if (node.is_leaf())
+                {
+                    hit_anything |= intersect(node.offset, node.count, t_min, t_max);
+                    if (hit_anything && any_hit)
+                        return true;
+                }
+                else if (dir_is_neg[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+
+            current = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+public:
+    std::vector<linear_bvh_node> nodes;
+
+    // 遍历时栈中最多保存从根节点到当前节点路径上每一层的另一个子节点
+    static constexpr int max_stack_depth = bvh_max_depth;
+
+private:
+    uint32_t flatten(const bvh_build_node &build_node, int depth = 1)
+    {
+        assert(depth <= bvh_max_depth && "bvh_builder limits the tree depth");
+
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        linear_bvh_node node = {};
+        for (int a = 0; a < 3; a++)
+        {
+            node.bounds_min[a] = conservative_float(build_node.bounds.min()[a], true);
+            node.bounds_max[a] = conservative_float(build_node.bounds.max()[a], false);
+        }
+
+        if (build_node.is_leaf())
+        {
+            node.offset = build_node.first;
+            node.count = static_cast<uint16_t>(build_node.count);
+        }
+        else
+        {
+            node.axis = static_cast<uint8_t>(build_node.split_axis);
+            flatten(*build_node.children[0], depth + 1);
+            node.offset = flatten(*build_node.children[1], depth + 1);
+        }
+
+        nodes[index] = node;
+        return index;
+    }
+};
+
+/**
+ * @brief 使用不含指针的 bvh 组织一组物体，可以替代 bvh_node；Tree 为节点数组的布局，
+ * 需要提供由 bvh_build_node 构造的构造函数以及 traverse() 和 empty()
+ *
+ * sphere 和 triangle 按类型直接调用非虚的 intersect 和 occluded，与遍历循环一起按指令集生成多个版本，
+ * 其余类型仍然通过虚函数求交
+ */
+template <typename Tree>
+class flat_bvh : public hittable
+{
+public:
+    flat_bvh() {}
+
+    /**
+     * @brief 为 hittable_list 构建 bvh
+     *
+     * @param list hittable_list 实例
+     * @param time0 相机快门时间下限
+     * @param time1 相机快门时间上限
+     * @param options 构建选项
+     * @param stats 不为空时用于保存构建统计信息
+     */
+    flat_bvh(const hittable_list &list, double time0, double time1,
+             const bvh_build_options &options = bvh_build_options(), bvh_build_stats *stats = nullptr)
+    {
+        bvh_builder builder(primitive_bounds(list.objects, 0, list.objects.size(), time0, time1), options);
+        auto root = builder.build();
+
+        if (stats)
+            *stats = builder.stats;
+
+        if (!root)
+            return;
+
+        box = root->bounds;
+        tree = Tree(root.get());
+
+        objects.reserve(builder.ordered_indices.size());
+        kinds.reserve(builder.ordered_indices.size());
+        for (auto index : builder.ordered_indices)
+        {
+            objects.push_back(list.objects[index]);
+            kinds.push_back(kind_of(*list.objects[index]));
+        }
+    }
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        return tree.traverse(r, t_min, t_max, [&](uint32_t index, double t_min, double &t_max) RTW_FORCE_INLINE
+                             {
+                                 if (!hit_object(index, r, t_min, t_max, rec))
+                                     return false;
+
+                                 t_max = rec.t;
+                                 return true; });
+    }
+
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return tree.traverse_leaves(
+            r, t_min, t_max, [&](uint32_t first, uint32_t count, double t_min, double &t_max) RTW_FORCE_INLINE
+            {
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    if (hit_any_object(i, r, t_min, t_max))
+                        return true;
+                }
+                return false; },
+            true);
+    }
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = box;
+        return !tree.empty();
+    }
+
+public:
+    std::vector<shared_ptr<hittable>> objects; // 按叶节点顺序排列的物体
+    Tree tree;
+    aabb box;
+
+private:
+    /**
+     * @brief 物体的类型，按实际类型精确匹配，sphere 和 triangle 的子类仍然通过虚函数求交
+     */
+    enum class object_kind : uint8_t
+    {
+        sphere,
+        triangle,
+        other,
+    };
+
+    std::vector<object_kind> kinds; // 与 objects 一一对应
+
+    static object_kind kind_of(const hittable &object)
+    {
+        const auto &type = typeid(object);
+
+        if (type == typeid(sphere))
+            return object_kind::sphere;
+        if (type == typeid(triangle))
+            return object_kind::triangle;
+        return object_kind::other;
+    }
+
+    RTW_FORCE_INLINE bool hit_object(uint32_t index, const ray &r, double t_min, double t_max, hit_record &rec) const
+    {
+        switch (kinds[index])
+        {
+        case object_kind::sphere:
+            return static_cast<const sphere &>(*objects[index]).intersect(r, t_min, t_max, rec);
+        case object_kind::triangle:
+            return static_cast<const triangle &>(*objects[index]).intersect(r, t_min, t_max, rec);
+        default:
+            return objects[index]->hit(r, t_min, t_max, rec);
+        }
+    }
+
+    RTW_FORCE_INLINE bool hit_any_object(uint32_t index, const ray &r, double t_min, double t_max) const
+    {
+        switch (kinds[index])
+        {
+        case object_kind::sphere:
+            return static_cast<const sphere &>(*objects[index]).occluded(r, t_min, t_max);
+        case object_kind::triangle:
+            return static_cast<const triangle &>(*objects[index]).occluded(r, t_min, t_max);
+        default:
+            return objects[index]->hit_any(r, t_min, t_max);
+        }
+    }
+};
+
+using linear_bvh = flat_bvh<linear_bvh_tree>;
+
+#endif
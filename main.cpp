@@ -1,61 +1,80 @@
 #include <iostream>
 #include <vector>
-#include <ctime>
 #include <fstream>
 #include <iomanip>
 
 #include "rtweekend.h"
 
-#include "color.h"
 #include "bvh.h"
 
 #include "scene_generator.h"
 #include "renderer.h"
+#include "image_io.h"
 
 int main()
 {
-    std::vector<shared_ptr<scene_generator>> scenes;
-    scenes.push_back(make_shared<random_scene>());              // 0
-    scenes.push_back(make_shared<two_spheres>());               // 1
-    scenes.push_back(make_shared<two_perlin_spheres>());        // 2
-    scenes.push_back(make_shared<earth>());                     // 3
-    scenes.push_back(make_shared<simple_light>());              // 4
-    scenes.push_back(make_shared<cornell_box>());               // 5
-    scenes.push_back(make_shared<cornell_smoke>());             // 6
-    scenes.push_back(make_shared<the_next_week_final_scene>()); // 7
-    scenes.push_back(make_shared<test_scene>());                // 8
-
+    auto scenes = all_scenes(); // 场景编号见 all_scenes()
     auto selected_scene = scenes[5];
+    // selected_scene->layout = bvh_layout::wide8; // 顶层加速结构的布局：binary / linear / wide4 / wide8
 
     // 设置 std::cerr 输出浮点数时保留 2 位精度
     std::cerr << std::setiosflags(std::ios::fixed) << std::setprecision(2);
 
+    std::string path = "../../results/";
+    std::string filename = selected_scene->output_filename();
+    std::string stem = filename.substr(0, filename.find_last_of('.'));
+    size_t pixel_count = static_cast<size_t>(selected_scene->image_width) * selected_scene->image_height;
+
     // rendering ===================================================================================================
-    multi_thread_renderer renderer(4, 4);
+    multi_thread_renderer renderer; // 默认使用全部硬件线程和 32x32 的 tile
     // single_thread_renderer renderer;
+    // renderer.options.integrator = integrator_type::mis; // recursive / iterative / mis
+    // renderer.options.light_selection = light_selection_type::bvh; // 光源很多时使用
+    // renderer.options.sampler = sampler_type::sobol; // independent / stratified / halton / sobol
+    // renderer.options.custom_sampler = make_shared<halton_sampler>(4096); // 自行创建的采样器，优先于 sampler
+    // renderer.options.adaptive = true; // 只为噪声大的像素追加采样，同时输出每个像素的采样数
+    // renderer.options.progressive_samples = 16; // 渐进式渲染，每一轮为所有像素追加的采样数
+    // renderer.options.checkpoint_file = "../../results/" + selected_scene->output_filename() + ".checkpoint";
+    // renderer.options.resume = true; // 从检查点继续渲染，可以先提高 samples_per_pixel
+    // renderer.options.time_budget = 60; // 限时渲染（秒），samples_per_pixel 作为采样数的上限
+    // 流式输出，用于超大分辨率：完成的 tile 直接写入文件，不在内存中保留整幅画面
+    // renderer.options.tile_writers = {make_shared<ppm_tile_writer>(path + filename),
+    //                                  make_shared<exr_tile_writer>(path + stem + ".exr")};
 
-    clock_t start = clock();
     renderer.render(selected_scene, selected_scene->lights());
-    clock_t end = clock();
 
     // generate image ==============================================================================================
-    std::string path = "../../results/";
-    std::string filename = selected_scene->output_filename();
-    std::ofstream output(path + filename);
-
-    output << "P3\n"
-           << selected_scene->image_width << ' ' << selected_scene->image_height << "\n255\n";
+    // 8 位的 PPM 用于直接查看，半精度的 EXR 保留高动态范围数据用于之后的色调映射；流式输出时已经写入
+    if (renderer.options.tile_writers.empty())
+    {
+        auto image = renderer.get_image();
+        write_ppm(path + filename, image, selected_scene->image_width, selected_scene->image_height);
+        write_exr(path + stem + ".exr", image, selected_scene->image_width, selected_scene->image_height);
+        // write_pfm(path + stem + ".pfm", image, selected_scene->image_width, selected_scene->image_height);
+    }
 
-    auto frame_buffer = renderer.get_frame_buffer();
-    for (size_t i = 0; i < frame_buffer.size(); i++)
+    if (renderer.options.adaptive)
     {
-        write_color(output, frame_buffer[i], selected_scene->samples_per_pixel);
+        write_sample_map(path + stem + "_samples.pgm", renderer.get_sample_counts(), selected_scene->image_width,
+                         selected_scene->image_height, selected_scene->samples_per_pixel);
     }
 
-    auto time = (end - start) / CLOCKS_PER_SEC;
-    auto minutes = time / 60;
-    auto seconds = time % 60;
-    std::cerr << "\nDone, cost time: " << minutes << " minutes, " << seconds << " seconds";
+    auto stats = renderer.get_stats();
+    std::cerr << "\nISA: " << active_isa()
+              << "\nScene build: " << stats.scene_seconds << " s (bvh: " << stats.bvh << ")"
+              << "\nRender: " << stats.render_seconds << " s, " << stats.rays / stats.render_seconds / 1e6 << " M rays/s"
+              << "\nSamples per pixel: " << 1.0 * stats.samples / pixel_count
+              << "\nClosest-hit traversals saved by any-hit queries: " << stats.saved_closest_hits
+              << "\nDone, total time: " << stats.scene_seconds + stats.render_seconds << " s";
+
+    if (renderer.options.time_budget > 0)
+    {
+        std::cerr << "\nTime budget: " << renderer.options.time_budget << " s"
+                  << "\n  pilot: " << stats.pilot_seconds << " s, " << stats.pilot_rays_per_second / 1e6 << " M rays/s"
+                  << "\n  predicted: " << stats.predicted_samples_per_pixel << " spp in " << stats.predicted_seconds << " s"
+                  << "\n  actual: " << 1.0 * stats.samples / pixel_count << " spp in "
+                  << stats.scene_seconds + stats.render_seconds << " s";
+    }
 
     return 0;
 }
@@ -12,7 +12,29 @@ struct scatter_record
     ray specular_ray;
     bool is_specular;
     color attenuation;
-    shared_ptr<pdf> pdf_ptr;
+    cosine_pdf pdf; // 非镜面散射时使用的 pdf，按值保存，避免每次散射都分配堆内存
+};
+
+/**
+ * @brief 颜色的亮度（Rec. 709 系数）
+ */
+inline double luminance(const color &c)
+{
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+/**
+ * @brief 内置材质的类型；渲染器按类型分支调用材质的函数，不经过虚函数表，
+ * custom 表示其他派生类，仍然通过虚函数调用
+ */
+enum class material_type
+{
+    custom,
+    lambertian,
+    metal,
+    dielectric,
+    diffuse_light,
+    isotropic,
 };
 
 /**
@@ -21,6 +43,8 @@ struct scatter_record
 class material
 {
 public:
+    material(material_type type = material_type::custom) : type(type) {}
+
     virtual color emitted(const ray &r, const hit_record &rec, double u, double v, const point3 &p) const
     {
         return color(0);
@@ -35,19 +59,30 @@ public:
     {
         return 0;
     }
+
+    /**
+     * @brief 材质表面的平均辐射亮度，用于估计光源的功率；不发光的材质返回 0
+     */
+    virtual color average_emission() const
+    {
+        return color(0);
+    }
+
+public:
+    material_type type;
 };
 
 class lambertian : public material
 {
 public:
-    lambertian(const color &a) : albedo(make_shared<solid_color>(a)) {}
-    lambertian(shared_ptr<texture> a) : albedo(a) {}
+    lambertian(const color &a) : material(material_type::lambertian), albedo(make_shared<solid_color>(a)) {}
+    lambertian(shared_ptr<texture> a) : material(material_type::lambertian), albedo(a) {}
 
     virtual bool scatter(const ray &r, const hit_record &rec, scatter_record &srec) const override
     {
         srec.is_specular = false;
         srec.attenuation = albedo->sample(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+        srec.pdf = cosine_pdf(rec.normal);
 
         return true;
     }
@@ -65,7 +100,7 @@ public:
 class metal : public material
 {
 public:
-    metal(const color &a, const float &f) : albedo(a), fuzz(f) {}
+    metal(const color &a, const float &f) : material(material_type::metal), albedo(a), fuzz(f) {}
 
     virtual bool scatter(const ray &r, const hit_record &rec, scatter_record &srec) const override
     {
@@ -73,7 +108,6 @@ public:
         srec.specular_ray = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
         srec.attenuation = albedo;
         srec.is_specular = true;
-        srec.pdf_ptr = nullptr;
 
         return true;
     }
@@ -86,12 +120,11 @@ public:
 class dielectric : public material
 {
 public:
-    dielectric(double ir) : ir(ir) {}
+    dielectric(double ir) : material(material_type::dielectric), ir(ir) {}
 
     virtual bool scatter(const ray &r, const hit_record &rec, scatter_record &srec) const override
     {
         srec.is_specular = true;
-        srec.pdf_ptr = nullptr;
         srec.attenuation = color(1.0, 1.0, 1.0);
 
         double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
@@ -133,15 +166,21 @@ private:
 class diffuse_light : public material
 {
 public:
-    diffuse_light(shared_ptr<texture> a) : emit(a) {}
+    diffuse_light(shared_ptr<texture> a) : material(material_type::diffuse_light), emit(a) {}
 
-    diffuse_light(color c) : emit(make_shared<solid_color>(c)) {}
+    diffuse_light(color c) : material(material_type::diffuse_light), emit(make_shared<solid_color>(c)) {}
 
     virtual bool scatter(const ray &r_in, const hit_record &rec, scatter_record &srec) const override
     {
         return false;
     }
 
+    virtual color average_emission() const override
+    {
+        // 以纹理中心的值作为估计，对 solid_color 是精确的
+        return emit->sample(0.5, 0.5, point3(0));
+    }
+
     virtual color emitted(const ray &r, const hit_record &rec, double u, double v, const point3 &p) const override
     {
         if (rec.front_face)
@@ -161,11 +200,11 @@ private:
 class isotropic : public material
 {
 public:
-    isotropic(shared_ptr<texture> a) : albedo(a)
+    isotropic(shared_ptr<texture> a) : material(material_type::isotropic), albedo(a)
     {
     }
 
-    isotropic(color c) : albedo(make_shared<solid_color>(c))
+    isotropic(color c) : material(material_type::isotropic), albedo(make_shared<solid_color>(c))
     {
     }
 
@@ -174,7 +213,6 @@ public:
         srec.specular_ray = ray(rec.p, random_in_unit_sphere(), r.time());
         srec.attenuation = albedo->sample(rec.u, rec.v, rec.p);
         srec.is_specular = true;
-        srec.pdf_ptr = nullptr;
 
         return true;
     }
@@ -183,4 +221,58 @@ private:
     shared_ptr<texture> albedo;
 };
 
+/**
+ * @brief 按材质类型分支调用 scatter；内置材质以限定名调用，编译器可以内联
+ */
+inline bool scatter(const material &mat, const ray &r, const hit_record &rec, scatter_record &srec)
+{
+    switch (mat.type)
+    {
+    case material_type::lambertian:
+        return static_cast<const lambertian &>(mat).lambertian::scatter(r, rec, srec);
+    case material_type::metal:
+        return static_cast<const metal &>(mat).metal::scatter(r, rec, srec);
+    case material_type::dielectric:
+        return static_cast<const dielectric &>(mat).dielectric::scatter(r, rec, srec);
+    case material_type::diffuse_light:
+        return static_cast<const diffuse_light &>(mat).diffuse_light::scatter(r, rec, srec);
+    case material_type::isotropic:
+        return static_cast<const isotropic &>(mat).isotropic::scatter(r, rec, srec);
+    default:
+        return mat.scatter(r, rec, srec);
+    }
+}
+
+/**
+ * @brief 按材质类型分支调用 emitted；内置材质中只有 diffuse_light 发光
+ */
+inline color emitted(const material &mat, const ray &r, const hit_record &rec)
+{
+    switch (mat.type)
+    {
+    case material_type::diffuse_light:
+        return static_cast<const diffuse_light &>(mat).diffuse_light::emitted(r, rec, rec.u, rec.v, rec.p);
+    case material_type::custom:
+        return mat.emitted(r, rec, rec.u, rec.v, rec.p);
+    default:
+        return color(0);
+    }
+}
+
+/**
+ * @brief 按材质类型分支调用 scattering_pdf；内置材质中只有 lambertian 有非镜面散射
+ */
+inline double scattering_pdf(const material &mat, const ray &r, const hit_record &rec, const ray &scattered)
+{
+    switch (mat.type)
+    {
+    case material_type::lambertian:
+        return static_cast<const lambertian &>(mat).lambertian::scattering_pdf(r, rec, scattered);
+    case material_type::custom:
+        return mat.scattering_pdf(r, rec, scattered);
+    default:
+        return 0;
+    }
+}
+
 #endif
@@ -1,17 +1,83 @@
 #ifndef MESH_H
-#define MEHS_H
+#define MESH_H
 
 #include "hittable.h"
 #include "hittable_list.h"
 #include "triangle.h"
 #include "bvh.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+#include "triangle_packet.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <variant>
+#include <vector>
+
+/**
+ * @brief 带索引的三角形网格数据；顶点属性按分量分开存放在 float 数组中（SoA），
+ * 每个三角形只占用索引缓冲中的 3 个 32 位下标
+ */
+struct mesh_data
+{
+    std::vector<float> px, py, pz; // 顶点坐标
+    std::vector<float> nx, ny, nz; // 顶点法线（已归一化）
+    std::vector<float> u, v;       // 顶点纹理坐标，OBJ 文件中没有时为 0
+    std::vector<uint32_t> indices; // 每 3 个下标构成一个三角形
+
+    size_t vertex_count() const { return px.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    point3 position(uint32_t i) const { return point3(px[i], py[i], pz[i]); }
+    vec3 normal(uint32_t i) const { return vec3(nx[i], ny[i], nz[i]); }
+    vec3 uv(uint32_t i) const { return vec3(u[i], v[i], 0); }
+
+    /**
+     * @brief 第 tri 个三角形的包围盒；与 triangle::bounding_box 相同，过薄的轴会稍微加厚
+     */
+    aabb triangle_bounds(size_t tri) const
+    {
+        point3 min(infinity, infinity, infinity);
+        point3 max(-infinity, -infinity, -infinity);
 
-std::vector<shared_ptr<triangle>> load_model_from_obj_file(const char *filename, shared_ptr<material> mat, float scale = 1.0f)
+        for (int k = 0; k < 3; k++)
+        {
+            auto p = position(indices[3 * tri + k]);
+            for (int a = 0; a < 3; a++)
+            {
+                min[a] = fmin(min[a], p[a]);
+                max[a] = fmax(max[a], p[a]);
+            }
+        }
+
+        for (int a = 0; a < 3; a++)
+        {
+            if (max[a] - min[a] < 0.0001f)
+            {
+                min[a] -= 0.0001f;
+                max[a] += 0.0001f;
+            }
+        }
+
+        return aabb(min, max);
+    }
+
+    /**
+     * @brief 顶点和索引缓冲占用的字节数
+     */
+    size_t memory_usage() const
+    {
+        return (px.size() + py.size() + pz.size() + nx.size() + ny.size() + nz.size() + u.size() + v.size()) * sizeof(float) +
+               indices.size() * sizeof(uint32_t);
+    }
+};
+
+/**
+ * @brief 读取 OBJ 文件中的顶点、纹理坐标和三角形，并计算平滑法线
+ */
+mesh_data load_mesh_data_from_obj_file(const char *filename, float scale = 1.0f)
 {
     std::ifstream file;
     file.open(filename, std::ios::in);
@@ -22,10 +88,8 @@ std::vector<shared_ptr<triangle>> load_model_from_obj_file(const char *filename,
         return {};
     }
 
-    std::vector<point3> positions;
-    std::vector<vec3> uvs;
-    std::vector<vec3> normals;
-    std::vector<uint32_t> indices;
+    mesh_data data;
+    std::vector<float> us, vs;
 
     // 读取顶点，UV，三角形索引信息
     std::string line;
@@ -40,70 +104,80 @@ std::vector<shared_ptr<triangle>> load_model_from_obj_file(const char *filename,
         {
             float x, y, z;
             ss >> x >> y >> z;
-            positions.push_back(point3(x * scale, y * scale, z * scale));
+            data.px.push_back(x * scale);
+            data.py.push_back(y * scale);
+            data.pz.push_back(z * scale);
         }
         else if (strcmp(type.c_str(), "vt") == 0)
         {
             float u, v;
             ss >> u >> v;
-            uvs.push_back(vec3(u, v, 0));
+            us.push_back(u);
+            vs.push_back(v);
         }
         else if (strcmp(type.c_str(), "f") == 0)
         {
             int i0, i1, i2;
             ss >> i0 >> i1 >> i2;
-            indices.push_back(i0 - 1);
-            indices.push_back(i1 - 1);
-            indices.push_back(i2 - 1);
+            data.indices.push_back(i0 - 1);
+            data.indices.push_back(i1 - 1);
+            data.indices.push_back(i2 - 1);
         }
     }
 
+    // 纹理坐标与顶点一一对应，缺少的部分补 0
+    size_t vertex_count = data.vertex_count();
+    us.resize(vertex_count, 0.0f);
+    vs.resize(vertex_count, 0.0f);
+    data.u = std::move(us);
+    data.v = std::move(vs);
+
     // 计算平滑法线
-    for (int i = 0; i < positions.size(); i++)
-    {
-        normals.push_back(vec3(0.0f));
-    }
-    for (int i = 0; i < indices.size(); i += 3)
+    std::vector<vec3> normals(vertex_count, vec3(0.0f));
+    for (size_t i = 0; i < data.indices.size(); i += 3)
     {
-        auto i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+        auto i0 = data.indices[i], i1 = data.indices[i + 1], i2 = data.indices[i + 2];
 
-        auto p0 = positions[i0];
-        auto p1 = positions[i1];
-        auto p2 = positions[i2];
+        auto p0 = data.position(i0);
+        auto p1 = data.position(i1);
+        auto p2 = data.position(i2);
 
         auto normal = cross(p1 - p0, p2 - p0);
         normals[i0] += normal;
         normals[i1] += normal;
         normals[i2] += normal;
     }
-    for (int i = 0; i < normals.size(); i++)
-    {
-        normals[i] = unit_vector(normals[i]);
-    }
-
-    // 构建三角形
-    auto defaultUV = vec3(0);
-    std::vector<shared_ptr<triangle>> triangles;
 
-    for (int i = 0; i < indices.size(); i += 3)
+    data.nx.resize(vertex_count);
+    data.ny.resize(vertex_count);
+    data.nz.resize(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++)
     {
-        auto i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+        auto n = unit_vector(normals[i]);
+        data.nx[i] = static_cast<float>(n.x());
+        data.ny[i] = static_cast<float>(n.y());
+        data.nz[i] = static_cast<float>(n.z());
+    }
 
-        auto p0 = positions[i0];
-        auto p1 = positions[i1];
-        auto p2 = positions[i2];
+    return data;
+}
 
-        auto n0 = normals[i0];
-        auto n1 = normals[i1];
-        auto n2 = normals[i2];
+/**
+ * @brief 读取 OBJ 文件并为每个面生成一个独立的 triangle 物体
+ */
+std::vector<shared_ptr<triangle>> load_model_from_obj_file(const char *filename, shared_ptr<material> mat, float scale = 1.0f)
+{
+    auto data = load_mesh_data_from_obj_file(filename, scale);
 
-        auto uv0 = i0 >= uvs.size() ? defaultUV : uvs[i0];
-        auto uv1 = i1 >= uvs.size() ? defaultUV : uvs[i1];
-        auto uv2 = i2 >= uvs.size() ? defaultUV : uvs[i2];
+    std::vector<shared_ptr<triangle>> triangles;
+    triangles.reserve(data.triangle_count());
+    for (size_t i = 0; i < data.indices.size(); i += 3)
+    {
+        auto i0 = data.indices[i], i1 = data.indices[i + 1], i2 = data.indices[i + 2];
 
-        auto v0 = vertex(p0, n0, uv0);
-        auto v1 = vertex(p1, n1, uv1);
-        auto v2 = vertex(p2, n2, uv2);
+        auto v0 = vertex(data.position(i0), data.normal(i0), data.uv(i0));
+        auto v1 = vertex(data.position(i1), data.normal(i1), data.uv(i1));
+        auto v2 = vertex(data.position(i2), data.normal(i2), data.uv(i2));
 
         triangles.push_back(make_shared<triangle>(v0, v1, v2, mat));
     }
@@ -111,68 +185,208 @@ std::vector<shared_ptr<triangle>> load_model_from_obj_file(const char *filename,
     return triangles;
 }
 
+/**
+ * @brief 三角形网格；顶点数据使用带索引的 SoA 存储，整个网格共享一个材质；
+ * 内部使用不含指针的 bvh 组织三角形，bvh 的布局可以是二叉或宽 bvh
+ *
+ * 构建 bvh 后索引缓冲按叶节点顺序重排，叶节点中的下标即三角形的序号；每个叶节点的三角形
+ * 另外打包为若干个 triangle_packet，求交时一次处理整个包，只为最终最近的交点计算法线和纹理坐标
+ */
 class mesh : public hittable
 {
 private:
-    hittable_list triangles;
-    bvh_node bvhNode;
+    // 网格的 bvh 不使用 bvh_node，bvh_layout::binary 按 linear 处理
+    using tree_type = std::variant<linear_bvh_tree, wide_bvh_tree<4>, wide_bvh_tree<8>>;
+
+    using packet = triangle_packet<triangle_packet_width>;
+
+    mesh_data data;
+    shared_ptr<material> mat;
+    tree_type bvh;
+    aabb box;
+
+    std::vector<packet> packets;          // 按叶节点顺序排列的三角形包
+    std::vector<uint32_t> leaf_packets;   // 以叶节点第一个三角形的序号为下标，保存该叶节点第一个包的下标
 
 public:
     mesh() {}
 
-    // mesh(shared_ptr<material> mat)
-    // {
-    //     const int width = 1;
-    //     const float size = 1.0f / width;
-    //     const float uv_stride = 0.5f / width;
+    mesh(const char *obj_filename, shared_ptr<material> mat, float scale = 1.0f,
+         bvh_layout layout = bvh_layout::linear, const bvh_build_options &options = bvh_build_options())
+        : mesh(load_mesh_data_from_obj_file(obj_filename, scale), mat, layout, options)
+    {
+    }
+
+    mesh(mesh_data source, shared_ptr<material> mat,
+         bvh_layout layout = bvh_layout::linear, const bvh_build_options &options = bvh_build_options())
+        : data(std::move(source)), mat(mat)
+    {
+        size_t count = data.triangle_count();
+        std::vector<aabb> bounds(count);
+        auto compute_bounds = [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+                bounds[i] = data.triangle_bounds(i);
+        };
+
+        if (options.pool)
+            options.pool->parallel_for(0, count, 16384, compute_bounds);
+        else
+            compute_bounds(0, count);
+
+        // 叶节点的三角形按包求交，叶节点中最多放满一个包
+        bvh_build_options mesh_options = options;
+        mesh_options.leaf_packet_width = triangle_packet_width;
+        mesh_options.max_leaf_size = std::max(options.max_leaf_size, triangle_packet_width);
+
+        bvh_builder builder(std::move(bounds), mesh_options);
+        auto root = builder.build();
+        if (!root)
+            return;
+
+        box = root->bounds;
+        if (layout == bvh_layout::wide4)
+            bvh = wide_bvh_tree<4>(root.get());
+        else if (layout == bvh_layout::wide8)
+            bvh = wide_bvh_tree<8>(root.get());
+        else
+            bvh = linear_bvh_tree(root.get());
+
+        std::vector<uint32_t> ordered(data.indices.size());
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int k = 0; k < 3; k++)
+                ordered[3 * i + k] = data.indices[3 * builder.ordered_indices[i] + k];
+        }
+        data.indices = std::move(ordered);
 
-    //     for (int y = -width; y < width; y++)
-    //     {
-    //         for (int x = -width; x < width; x++)
-    //         {
-    //             auto p0 = point3(x * size, y * size, -1.0f);
-    //             auto p1 = point3((x + 1) * size, y * size, -1.0f);
-    //             auto p2 = point3(x * size, (y + 1) * size, -1.0f);
-    //             auto p3 = point3((x + 1) * size, (y + 1) * size, -1.0f);
+        build_packets(*root);
+    }
 
-    //             auto uv0 = vec3((x + width) * uv_stride, (y + width) * uv_stride, 0);
-    //             auto uv1 = vec3((x + 1 + width) * uv_stride, (y + width) * uv_stride, 0);
-    //             auto uv2 = vec3((x + width) * uv_stride, (y + 1 + width) * uv_stride, 0);
-    //             auto uv3 = vec3((x + 1 + width) * uv_stride, (y + 1 + width) * uv_stride, 0);
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        return intersect(r, t_min, t_max, &rec);
+    }
 
-    //             vertex v0 = {p0, uv0};
-    //             vertex v1 = {p1, uv1};
-    //             vertex v2 = {p2, uv2};
-    //             vertex v3 = {p3, uv3};
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return intersect(r, t_min, t_max, nullptr);
+    }
 
-    //             triangles.add(make_shared<triangle>(v0, v1, v2, mat));
-    //             triangles.add(make_shared<triangle>(v1, v3, v2, mat));
-    //         }
-    //     }
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = box;
+        return data.triangle_count() > 0;
+    }
 
-    //     bvhNode = bvh_node(triangles, 0.0, 1.0);
-    // }
+    size_t triangle_count() const { return data.triangle_count(); }
 
-    mesh(const char *obj_filename, shared_ptr<material> mat, float scale = 1.0f)
+    /**
+     * @brief 网格数据与 bvh 节点占用的字节数
+     */
+    size_t memory_usage() const
     {
-        auto tris = load_model_from_obj_file(obj_filename, mat, scale);
+        return sizeof(mesh) + data.memory_usage() +
+               packets.size() * sizeof(packet) + leaf_packets.size() * sizeof(uint32_t) +
+               std::visit([](const auto &tree)
+                          { return tree.nodes.size() * sizeof(tree.nodes[0]); },
+                          bvh);
+    }
 
-        for (int i = 0; i < tris.size(); i++)
+private:
+    /**
+     * @brief 求交的实现，由 hit 和 hit_any 转发；三角形包的求交内联到按指令集生成多个版本的 bvh 遍历中
+     *
+     * @param rec 为空时只判断是否相交，击中第一个叶节点中的三角形后立即返回
+     */
+    bool intersect(const ray &r, double t_min, double t_max, hit_record *rec) const
+    {
+        triangle_packet_ray pr;
+        for (int a = 0; a < 3; a++)
         {
-            triangles.add(tris[i]);
+            pr.origin[a] = static_cast<float>(r.origin()[a]);
+            pr.direction[a] = static_cast<float>(r.direction()[a]);
         }
 
-        bvhNode = bvh_node(triangles, 0.0, 1.0);
+        // 遍历过程中只记录最近交点的 t、重心坐标和三角形序号
+        triangle_packet_hit closest;
+        auto intersect_leaf = [&](uint32_t first, uint32_t count, double t_min, double &t_max)
+        {
+            uint32_t begin = leaf_packets[first];
+            uint32_t end = begin + (count + triangle_packet_width - 1) / triangle_packet_width;
+
+            float t = static_cast<float>(t_max);
+            bool hit_anything = false;
+            for (uint32_t i = begin; i < end; i++)
+                hit_anything |= intersect_packet(packets[i], pr, static_cast<float>(t_min), t, closest);
+
+            if (hit_anything)
+                t_max = t;
+            return hit_anything;
+        };
+
+        bool hit_anything = std::visit([&](const auto &tree)
+                                       { return tree.traverse_leaves(r, t_min, t_max, intersect_leaf, !rec); },
+                                       bvh);
+        if (hit_anything && rec)
+            fill_hit_record(closest, r, *rec);
+
+        return hit_anything;
     }
 
-    virtual bool hit(const ray &ray, double t_min, double t_max, hit_record &rec) const override
+    /**
+     * @brief 为每个叶节点的三角形生成三角形包，不足的通道填充退化三角形
+     */
+    void build_packets(const bvh_build_node &node)
     {
-        return bvhNode.hit(ray, t_min, t_max, rec);
+        if (!node.is_leaf())
+        {
+            build_packets(*node.children[0]);
+            build_packets(*node.children[1]);
+            return;
+        }
+
+        if (leaf_packets.empty())
+            leaf_packets.resize(data.triangle_count());
+        leaf_packets[node.first] = static_cast<uint32_t>(packets.size());
+
+        for (uint32_t first = node.first; first < node.first + node.count; first += triangle_packet_width)
+        {
+            packet p;
+            for (int lane = 0; lane < triangle_packet_width; lane++)
+            {
+                uint32_t tri = first + lane;
+                if (tri >= node.first + node.count)
+                {
+                    p.clear(lane);
+                    continue;
+                }
+
+                p.set(lane, tri, data.position(data.indices[3 * tri]),
+                      data.position(data.indices[3 * tri + 1]), data.position(data.indices[3 * tri + 2]));
+            }
+            packets.push_back(p);
+        }
     }
 
-    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    /**
+     * @brief 根据最近交点计算完整的表面属性
+     */
+    void fill_hit_record(const triangle_packet_hit &hit, const ray &ray, hit_record &rec) const
     {
-        return bvhNode.bounding_box(time0, time1, output_box);
+        auto i0 = data.indices[3 * hit.index], i1 = data.indices[3 * hit.index + 1], i2 = data.indices[3 * hit.index + 2];
+        auto u = hit.u, v = hit.v;
+
+        auto uv0 = data.uv(i0);
+        auto uv = (data.uv(i1) - uv0) * u + (data.uv(i2) - uv0) * v + uv0;
+        auto normal = unit_vector((1.0f - u - v) * data.normal(i0) + u * data.normal(i1) + v * data.normal(i2));
+
+        rec.t = hit.t;
+        rec.u = uv.x();
+        rec.v = uv.y();
+        rec.set_face_normal(ray, normal);
+        rec.mat = mat.get();
+        rec.p = ray.at(hit.t);
     }
 };
 
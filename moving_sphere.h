@@ -14,6 +14,8 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override;
+
     virtual bool bounding_box(double center0, double center1, aabb &output_box) const override;
 
     point3 center(double time) const;
@@ -56,11 +58,31 @@ bool moving_sphere::hit(const ray &r, double t_min, double t_max, hit_record &re
     rec.p = r.at(rec.t);
     auto outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat = mat;
+    rec.mat = mat.get();
 
     return true;
 }
 
+bool moving_sphere::hit_any(const ray &r, double t_min, double t_max) const
+{
+    vec3 oc = r.origin() - center(r.time());
+    auto a = r.direction().length_squared();
+    auto half_b = dot(oc, r.direction());
+    auto c = oc.length_squared() - radius * radius;
+
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant < 0)
+        return false;
+    auto sqrtd = sqrt(discriminant);
+
+    auto root = (-half_b - sqrtd) / a;
+    if (root >= t_min && root <= t_max)
+        return true;
+
+    root = (-half_b + sqrtd) / a;
+    return root >= t_min && root <= t_max;
+}
+
 bool moving_sphere::bounding_box(double time0, double time1, aabb &output_box) const
 {
     aabb box0(center(time0) - vec3(radius, radius, radius),
@@ -3,9 +3,10 @@
 
 #include "rtweekend.h"
 #include "onb.h"
+#include "hittable.h"
 
 /**
- * @brief 概率密度函数
+ * @brief 概率密度函数；各个 pdf 都是值类型，在渲染时直接在栈上构造，不分配堆内存
  */
 class pdf
 {
@@ -23,6 +24,7 @@ private:
     onb uvw;
 
 public:
+    cosine_pdf() {}
     cosine_pdf(const vec3 &w) { uvw.build_from_w(w); }
 
     virtual double sample(const vec3 &direction) const override
@@ -41,32 +43,36 @@ class hittable_pdf : public pdf
 {
 private:
     point3 o;
-    shared_ptr<hittable> object;
+    const hittable &object;
 
 public:
-    hittable_pdf(shared_ptr<hittable> object, const point3 &origin)
-        : object(object), o(origin)
+    hittable_pdf(const hittable &object, const point3 &origin)
+        : o(origin), object(object)
     {
     }
 
     virtual double sample(const vec3 &direction) const override
     {
-        return object->pdf_value(o, direction);
+        return object.pdf_value(o, direction);
     }
 
     virtual vec3 generate() const override
     {
-        return object->random(o);
+        return object.random(o);
     }
 };
 
+/**
+ * @brief 以相同的概率混合两个 pdf；只保存指向两个 pdf 的指针，调用者需要保证
+ * 两个 pdf 的生命周期长于 mixture_pdf
+ */
 class mixture_pdf : public pdf
 {
 private:
-    shared_ptr<pdf> p[2];
+    const pdf *p[2];
 
 public:
-    mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) : p{p0, p1}
+    mixture_pdf(const pdf *p0, const pdf *p1) : p{p0, p1}
     {
     }
 
@@ -88,4 +94,4 @@ public:
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,93 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+/**
+ * @brief 基于计数器的随机数生成器；第 n 个随机数只由 (key, n) 决定，key 由像素下标和
+ * 采样序号哈希得到，n 即当前采样已经消耗的随机数维度；因此渲染结果与线程数量和线程
+ * 调度顺序无关，每个线程也只读写自己的状态
+ *
+ * 输出函数使用 SplitMix64 的混合函数，各个维度之间没有依赖，便于一次生成多个通道
+ */
+class counter_rng
+{
+public:
+    counter_rng() {}
+    counter_rng(uint64_t key) : key(key) {}
+
+    /**
+     * @brief 切换到指定像素、指定采样的随机数序列，并从第 0 维开始
+     *
+     * @param stream 全局种子，不同的 stream 得到互不相关的整幅图像的随机数
+     */
+    void seed(uint64_t pixel_index, uint64_t sample_index, uint64_t stream = 0)
+    {
+        key = mix(mix(mix(stream) + pixel_index + 0x9e3779b97f4a7c15ull) ^ sample_index);
+        counter = 0;
+    }
+
+    /**
+     * @brief 跳转到当前序列的指定维度
+     */
+    void set_dimension(uint32_t dimension) { counter = dimension; }
+    uint32_t dimension() const { return counter; }
+
+    uint64_t next_uint64()
+    {
+        return value(counter++);
+    }
+
+    /**
+     * @brief 返回一个范围在 [0, 1) 内的随机数
+     */
+    double next_double()
+    {
+        return to_double(next_uint64());
+    }
+
+    /**
+     * @brief 一次生成 N 个连续维度的随机数；各通道互不依赖，循环可被编译器向量化，
+     * 供按 4/8 通道处理数据的 SIMD 代码使用
+     */
+    template <int N>
+    void next_doubles(double (&out)[N])
+    {
+        for (int i = 0; i < N; i++)
+            out[i] = to_double(value(counter + i));
+
+        counter += N;
+    }
+
+    template <int N>
+    void next_floats(float (&out)[N])
+    {
+        for (int i = 0; i < N; i++)
+            out[i] = static_cast<float>(value(counter + i) >> 40) * 0x1.0p-24f;
+
+        counter += N;
+    }
+
+    static uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    uint64_t key = 0;
+    uint32_t counter = 0;
+
+    uint64_t value(uint32_t n) const
+    {
+        return mix(key + (static_cast<uint64_t>(n) + 1) * 0x9e3779b97f4a7c15ull);
+    }
+
+    static double to_double(uint64_t x)
+    {
+        return static_cast<double>(x >> 11) * 0x1.0p-53;
+    }
+};
+
+#endif
@@ -3,28 +3,36 @@
 
 #include "vec3.h"
 
-class ray
+/**
+ * @brief 射线；T 为标量类型，项目中通过 ray 使用
+ */
+template <typename T>
+class ray_t
 {
 public:
-    ray() {}
-    ray(const point3 &origin, const vec3 &direction, double time = 0.0)
+    using vec = vec3_t<T>;
+
+    ray_t() {}
+    ray_t(const vec &origin, const vec &direction, T time = 0.0)
         : orig(origin), dir(direction), tm(time)
     {
     }
 
-    point3 origin() const { return orig; }
-    vec3 direction() const { return dir; }
-    double time() const { return tm; }
+    vec origin() const { return orig; }
+    vec direction() const { return dir; }
+    T time() const { return tm; }
 
-    point3 at(double t) const
+    RTW_FORCE_INLINE vec at(T t) const
     {
         return orig + t * dir;
     }
 
 private:
-    point3 orig;
-    vec3 dir;
-    double tm;
+    vec orig;
+    vec dir;
+    T tm;
 };
 
+using ray = ray_t<real>;
+
 #endif
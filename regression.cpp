@@ -0,0 +1,121 @@
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "scene_generator.h"
+#include "renderer.h"
+#include "image_io.h"
+
+// 精度回归测试；同一份源码分别以双精度（regression）和单精度（regression_float，
+// 定义 RTW_USE_FLOAT）构建，各自把所有场景渲染为 PFM，再比较两组图像的误差
+//
+// 用法：
+//   regression render <输出目录> [图像宽度] [每像素采样数] [随机数种子]
+//   regression compare <目录 A> <目录 B>
+//
+// 与主程序一样通过 ../../res/ 读取模型和贴图，需要在构建目录下两级的子目录中运行；
+// 比较同一构建使用不同种子的渲染结果，可以得到采样噪声本身带来的误差作为参照
+
+std::string scene_name(const scene_generator &scene)
+{
+    auto name = scene.output_filename();
+    return name.substr(0, name.find_last_of('.'));
+}
+
+int render(const std::string &directory, int image_width, int samples_per_pixel, uint64_t seed)
+{
+    std::cout << "precision: " << (sizeof(real) == sizeof(float) ? "float" : "double") << "\n";
+
+    multi_thread_renderer renderer;
+    renderer.options.show_progress = false;
+    renderer.options.seed = seed;
+
+    for (const auto &scene : all_scenes())
+    {
+        scene->image_width = image_width;
+        scene->image_height = static_cast<int>(image_width / scene->aspect_ratio);
+        scene->samples_per_pixel = samples_per_pixel;
+
+        renderer.render(scene, scene->lights());
+
+        auto image = average_samples(renderer.get_frame_buffer(), samples_per_pixel);
+        auto filename = directory + "/" + scene_name(*scene) + ".pfm";
+        if (!write_pfm(filename, image, scene->image_width, scene->image_height))
+        {
+            std::cerr << "failed to write " << filename << "\n";
+            return 1;
+        }
+
+        auto stats = renderer.get_stats();
+        std::cout << std::left << std::setw(28) << scene_name(*scene) << stats.render_seconds << " s, "
+                  << stats.rays / stats.render_seconds << " rays/s\n";
+    }
+
+    return 0;
+}
+
+int compare(const std::string &directory_a, const std::string &directory_b)
+{
+    std::cout << std::left << std::setw(28) << "scene" << std::setw(14) << "rmse"
+              << std::setw(14) << "relative rmse" << "max abs error\n";
+
+    for (const auto &scene : all_scenes())
+    {
+        auto name = scene_name(*scene);
+
+        std::vector<color> a, b;
+        int width_a, height_a, width_b, height_b;
+        if (!read_pfm(directory_a + "/" + name + ".pfm", a, width_a, height_a) ||
+            !read_pfm(directory_b + "/" + name + ".pfm", b, width_b, height_b) ||
+            width_a != width_b || height_a != height_b)
+        {
+            std::cout << std::setw(28) << name << "missing or mismatched image\n";
+            continue;
+        }
+
+        // 相对误差以两幅图像的平均亮度归一化
+        double squared_error = 0, mean = 0, max_error = 0;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                double d = std::fabs(a[i][c] - b[i][c]);
+                squared_error += d * d;
+                mean += 0.5 * (a[i][c] + b[i][c]);
+                max_error = std::fmax(max_error, d);
+            }
+        }
+
+        double rmse = std::sqrt(squared_error / (3.0 * a.size()));
+        mean /= 3.0 * a.size();
+
+        std::cout << std::setw(28) << name << std::setw(14) << rmse
+                  << std::setw(14) << (mean > 0 ? rmse / mean : 0.0) << max_error << "\n";
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    if (mode == "render" && argc > 2)
+    {
+        int image_width = argc > 3 ? std::stoi(argv[3]) : 120;
+        int samples_per_pixel = argc > 4 ? std::stoi(argv[4]) : 16;
+        uint64_t seed = argc > 5 ? std::stoull(argv[5]) : 0;
+        return render(argv[2], image_width, samples_per_pixel, seed);
+    }
+
+    if (mode == "compare" && argc > 3)
+        return compare(argv[2], argv[3]);
+
+    std::cerr << "usage: regression render <directory> [width] [samples per pixel] [seed]\n"
+              << "       regression compare <directory a> <directory b>\n";
+    return 1;
+}
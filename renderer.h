@@ -1,7 +1,12 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
 #include <mutex>
 #include <vector>
 
@@ -10,36 +15,806 @@
 #include "material.h"
 #include "scene_generator.h"
 #include "pdf.h"
+#include "light_sampler.h"
+#include "light_bvh.h"
+#include "thread_pool.h"
+#include "checkpoint.h"
+#include "tile_writer.h"
+
+/**
+ * @brief 积分器类型
+ */
+enum class integrator_type
+{
+    recursive, // 每次弹射递归调用一次 ray_color，只在达到最大深度或未击中物体时停止
+    iterative, // 循环累积路径通量（throughput），并用俄罗斯轮盘赌提前终止贡献很小的路径
+    mis,       // 在 iterative 的基础上分别按光源和按材质采样，两种策略的贡献按多重重要性采样的权重合并
+};
+
+/**
+ * @brief 多重重要性采样中合并两种采样策略时使用的权重
+ */
+enum class mis_heuristic
+{
+    balance, // w_a = p_a / (p_a + p_b)
+    power,   // w_a = p_a^2 / (p_a^2 + p_b^2)，两种策略的 pdf 相差较大时噪声更低
+};
+
+/**
+ * @brief 对光源进行重要性采样时选择光源的方式
+ */
+enum class light_selection_type
+{
+    uniform, // 以相同的概率选择每个光源（hittable_list::random）
+    power,   // 按光源功率（辐射亮度 × 面积）构建别名表，见 light_sampler
+    bvh,     // 按光源对着色点的重要性在光源 bvh 中选择，见 light_bvh；适用于大量光源的场景
+};
+
+/**
+ * @brief 渲染器选项
+ */
+struct render_options
+{
+    integrator_type integrator = integrator_type::recursive;
+    int russian_roulette_depth = 3; // 从第几次弹射开始进行俄罗斯轮盘赌
+    mis_heuristic heuristic = mis_heuristic::power; // 只用于 integrator_type::mis
+    sampler_type sampler = sampler_type::independent; // 像素、镜头、快门时间和每次弹射使用的随机数来源
+    shared_ptr<::sampler> custom_sampler;             // 不为空时使用该采样器代替按 sampler 创建的采样器
+    light_selection_type light_selection = light_selection_type::power;
+    uint64_t seed = 0;              // 随机数种子，相同的种子得到相同的图像
+    bool show_progress = true;      // 是否在 std::cerr 中输出渲染进度
+
+    // 自适应采样：先为每个像素渲染 adaptive_min_samples 个采样，之后每一轮只为估计误差高于
+    // adaptive_threshold 的像素再追加 adaptive_min_samples 个采样，直到达到场景的 samples_per_pixel
+    bool adaptive = false;
+    int adaptive_min_samples = 16;
+    double adaptive_threshold = 0.01; // 伽马校正后的像素值（0 到 1）的估计标准误差
+
+    // 渐进式渲染：每一轮为所有像素追加 progressive_samples 个采样，为 0 时一次渲染完所有采样
+    int progressive_samples = 0;
+
+    // 检查点：checkpoint_file 不为空时，在一轮结束且距上次保存超过 checkpoint_seconds 秒时以及渲染结束时
+    // 保存每个像素的采样之和与采样数；resume 为 true 且检查点存在时从中继续渲染，
+    // 此时可以提高场景的 samples_per_pixel 继续追加采样
+    std::string checkpoint_file;
+    double checkpoint_seconds = 60;
+    bool resume = false;
+
+    // 限时渲染：time_budget 大于 0 时，从调用 render 开始（包括构建场景）经过 time_budget 秒后停止，
+    // 场景的 samples_per_pixel 作为采样数的上限；先以 pilot_samples 个采样试渲染整幅画面来预测能达到的采样数
+    double time_budget = 0;
+    int pilot_samples = 1;
+
+    // 流式输出：tile_writers 不为空时，每个 tile 渲染完成后立即写入这些文件，不分配整幅画面的 frame buffer，
+    // 内存占用只与同时渲染的 tile 数量有关。自适应采样、渐进式渲染、检查点和限时渲染需要整幅画面的数据，
+    // 与它们同时使用时仍在内存中渲染，结束后再逐个 tile 写入
+    std::vector<shared_ptr<tile_writer>> tile_writers;
+    int stream_tile_size = 64; // 流式输出时 tile 的边长（像素），也是 tile 存储的 EXR 文件中 tile 的大小
+};
+
+/**
+ * @brief 一次渲染的统计信息
+ */
+struct render_stats
+{
+    uint64_t rays = 0;               // 求交的射线数量（包括相机射线和所有弹射射线）
+    uint64_t saved_closest_hits = 0; // 由 any_hit_query 代替的最近交点查询次数（光源的 pdf_value 和 MIS 的阴影射线）
+    double scene_seconds = 0;        // 生成场景和构建加速结构的耗时（墙上时间），不计入 render_seconds
+    double render_seconds = 0;       // 渲染耗时（墙上时间）
+    uint64_t samples = 0;            // 所有像素的采样数之和
+    bvh_build_stats bvh;             // 顶层 bvh 的构建统计信息
+
+    // 以下只用于限时渲染
+    double pilot_seconds = 0;               // 试渲染的耗时
+    double pilot_rays_per_second = 0;       // 试渲染时每秒求交的射线数量
+    double predicted_samples_per_pixel = 0; // 试渲染后预测截止时间前能达到的平均采样数
+    double predicted_seconds = 0;           // 预测的总耗时（包括构建场景）
+};
+
+// 当前线程已求交的射线数量，由渲染器在每个 tile 结束时汇总
+inline thread_local uint64_t thread_ray_count = 0;
+
+/**
+ * @brief 一个像素的采样统计，用 Welford 算法在线更新采样亮度的均值和方差
+ */
+struct pixel_statistics
+{
+    uint32_t count = 0;
+    double mean = 0;
+    double m2 = 0; // 各采样与均值之差的平方和
+
+    void add(double x)
+    {
+        count++;
+        double delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+    }
+
+    double variance() const
+    {
+        return count > 1 ? m2 / (count - 1) : 0;
+    }
+
+    /**
+     * @brief 均值的标准误差换算到伽马校正（开平方，与 write_color 相同）之后的像素值上的误差；
+     * 暗处同样的绝对误差在显示时更明显
+     */
+    double display_error() const
+    {
+        if (count == 0)
+            return infinity;
+
+        return sqrt(variance() / count) / (2 * sqrt(fmax(mean, 1e-4)));
+    }
+};
+
+/**
+ * @brief 一次渲染中保持不变的数据，由 render 准备后传给每一个 pass
+ */
+struct frame_context
+{
+    const hittable *world;
+    const hittable *lights;
+    camera cam;
+    color background_color;
+    int image_width;
+    int image_height;
+    int samples_per_pixel;
+    int max_depth;
+};
 
 class renderer
 {
 public:
-    virtual void render(const shared_ptr<scene_generator> &scene, const shared_ptr<hittable> &lights) = 0;
+    render_options options;
+
+    /**
+     * @brief 渲染场景，每个像素最多渲染 samples_per_pixel 个采样；
+     * 不使用自适应采样和渐进式渲染时只有一个 pass
+     */
+    void render(const shared_ptr<scene_generator> &scene, const shared_ptr<hittable> &lights)
+    {
+        render_call_start = std::chrono::steady_clock::now();
+        has_deadline = options.time_budget > 0;
+        if (has_deadline)
+            deadline = render_call_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                               std::chrono::duration<double>(options.time_budget));
 
+        auto world_ptr = build_world(scene, worker_pool());
+        auto light_set_ptr = light_set(lights);
+        frame_context ctx{world_ptr.get(), light_set_ptr.get(), scene->get_camera(), scene->background_color,
+                          scene->image_width, scene->image_height, scene->samples_per_pixel, scene->max_depth};
+
+        scene_key = scene_checkpoint_key(scene->output_filename(), ctx.max_depth, ctx.background_color);
+        sampler_spp = ctx.samples_per_pixel;
+        pixel_sampler = options.custom_sampler ? options.custom_sampler : make_sampler(options.sampler, sampler_spp);
+
+        size_t pixel_count = static_cast<size_t>(ctx.image_width) * ctx.image_height;
+        frame_width = ctx.image_width;
+        frame_height = ctx.image_height;
+        open_tile_writers(ctx);
+
+        if (streaming)
+        {
+            render_streaming(ctx);
+            close_tile_writers();
+            return;
+        }
+
+        frame_buffer.assign(pixel_count, color(0));
+        sample_counts.assign(pixel_count, 0);
+        pixel_stats.assign(options.adaptive ? pixel_count : 0, pixel_statistics());
+        target_samples = ctx.samples_per_pixel;
+        if (options.resume)
+            load_checkpoint(ctx);
+
+        // 进度只统计本次渲染需要追加的采样
+        progress_total = 0;
+        for (auto count : sample_counts)
+            progress_total += std::max(ctx.samples_per_pixel - count, 0);
+        progress_total = std::max<uint64_t>(progress_total, 1);
+
+        begin_stats();
+        last_checkpoint = render_start;
+        checkpoint_samples = 0;
+
+        if (options.adaptive)
+        {
+            render_adaptive(ctx);
+        }
+        else if (has_deadline)
+        {
+            render_budgeted(ctx);
+        }
+        else
+        {
+            // 渐进式渲染时每一轮追加 progressive_samples 个采样，否则一轮渲染完所有剩余的采样
+            int batch = options.progressive_samples > 0 ? options.progressive_samples : ctx.samples_per_pixel;
+            std::vector<int> pass_samples(pixel_count);
+            while (remaining_samples(ctx, batch, pass_samples))
+            {
+                render_pass(ctx, pass_samples);
+                end_pass(false);
+            }
+        }
+
+        end_pass(true);
+        end_stats();
+        update_progress(1.0);
+
+        if (!options.tile_writers.empty())
+        {
+            write_frame_tiles();
+            close_tile_writers();
+        }
+    }
+
+    /**
+     * @brief 每个像素按实际采样数取平均后的图像，NaN 视为 0；只复制一份 frame buffer，
+     * 比 get_frame_buffer 之后再取平均少一份整幅画面的拷贝
+     */
+    std::vector<color> get_image() const
+    {
+        std::vector<color> image(frame_buffer.size());
+        for (size_t m = 0; m < image.size(); m++)
+            image[m] = average_pixel(frame_buffer[m], sample_counts[m]);
+
+        return image;
+    }
+
+    /**
+     * @brief 每个像素为 samples_per_pixel 个采样之和（流式输出时为空）；像素实际的采样数不同时（自适应采样、从采样数更多的检查点继续）
+     * 按实际的采样数缩放到相同的尺度，因此总是可以除以 samples_per_pixel 得到平均值
+     */
     std::vector<color> get_frame_buffer() const
     {
-        return frame_buffer;
+        auto image = frame_buffer;
+        for (size_t m = 0; m < image.size(); m++)
+        {
+            if (sample_counts[m] > 0 && sample_counts[m] != target_samples)
+                image[m] *= static_cast<double>(target_samples) / sample_counts[m];
+        }
+
+        return image;
+    }
+
+    /**
+     * @brief 每个像素实际渲染的采样数，顺序与 frame buffer 相同
+     */
+    std::vector<int> get_sample_counts() const
+    {
+        return sample_counts;
+    }
+
+    render_stats get_stats() const
+    {
+        return stats;
     }
 
 protected:
-    std::vector<color> frame_buffer;
+    std::vector<color> frame_buffer; // 每个像素的采样之和
+    std::vector<int> sample_counts;
+    int frame_width = 0, frame_height = 0;
+    int target_samples = 0;
+    std::vector<pixel_statistics> pixel_stats; // 只在自适应采样时使用
+    bool streaming = false;                    // 本次渲染是否流式输出，不保留 frame buffer
+    shared_ptr<sampler> pixel_sampler;         // options.custom_sampler 或按 options.sampler 创建，所有线程共享
+    int sampler_spp = 0;                       // 创建 pixel_sampler 时的每像素采样数，从检查点继续时沿用检查点中的值
+    uint64_t scene_key = 0;                    // 当前场景的 scene_checkpoint_key
+    render_stats stats;
+    std::atomic<uint64_t> ray_counter{0};
+    std::atomic<uint64_t> saved_closest_hit_counter{0};
+
+    /**
+     * @brief 渲染一个 pass：为 frame buffer 中下标为 m 的像素追加 pass_samples[m] 个采样，为 0 的像素跳过
+     */
+    virtual void render_pass(const frame_context &ctx, const std::vector<int> &pass_samples) = 0;
+
+    /**
+     * @brief 并行构建加速结构时使用的线程池，为 nullptr 时在当前线程中构建
+     */
+    virtual thread_pool *worker_pool() { return nullptr; }
+
+    /**
+     * @brief 把画面从左上角开始切分为 tile_size × tile_size 的 tile（y 向下），对每个 tile 调用 render_tile(x0, y0, w, h)，
+     * 返回时所有 tile 都已完成；默认在当前线程中按行优先的顺序依次调用
+     */
+    virtual void for_each_tile(int width, int height, int tile_size,
+                               const std::function<void(int, int, int, int)> &render_tile)
+    {
+        for (int y0 = 0; y0 < height; y0 += tile_size)
+        {
+            for (int x0 = 0; x0 < width; x0 += tile_size)
+                render_tile(x0, y0, std::min(tile_size, width - x0), std::min(tile_size, height - y0));
+        }
+    }
+
+    /**
+     * @brief 为 frame buffer 中下标为 m 的像素 (i, j) 追加 count 个采样，采样序号接着该像素已有的采样数，
+     * 因此分多个 pass 渲染与一次渲染相同数量的采样得到相同的结果
+     *
+     * @return 实际追加的采样数；限时渲染到达截止时间后不再追加采样，返回 0
+     */
+    int render_pixel(const frame_context &ctx, int i, int j, int m, int count)
+    {
+        if (has_deadline && std::chrono::steady_clock::now() >= deadline)
+            return 0;
+
+        frame_buffer[m] += render_samples(ctx, i, j, m, sample_counts[m], count);
+        sample_counts[m] += count;
+        return count;
+    }
+
+    /**
+     * @brief 渲染像素 (i, j) 序号从 first 开始的 count 个采样，返回它们的和；m 为像素在 frame buffer 中的下标，
+     * 用于选择随机数序列，流式输出时不分配 frame buffer，但仍使用相同的下标，得到与在内存中渲染相同的结果
+     *
+     * 按指令集生成多个版本，camera::get_ray 内联到每个版本中
+     */
+    RTW_MULTIVERSION color render_samples(const frame_context &ctx, int i, int j, int m, int first, int count)
+    {
+        color pixel_color(0, 0, 0);
+        for (int s = first; s < first + count; s++)
+        {
+            thread_sampler.seed(m, s, options.seed);
+
+            auto u = (i + random_double()) / (ctx.image_width - 1);
+            auto v = (j + random_double()) / (ctx.image_height - 1);
+            ray r = ctx.cam.get_ray(u, v);
+
+            color sample = trace(r, ctx.background_color, *ctx.world, ctx.lights, ctx.max_depth);
+            pixel_color += sample;
+
+            if (!pixel_stats.empty())
+            {
+                // 与 write_color 相同，将 NaN 视为 0
+                auto y = luminance(sample);
+                pixel_stats[m].add(y == y ? y : 0.0);
+            }
+        }
+
+        return pixel_color;
+    }
+
+    /**
+     * @brief 流式输出：每个 tile 在自己的缓冲区中渲染完所有采样后立即交给 tile_writers，缓冲区随即释放
+     */
+    void render_streaming(const frame_context &ctx)
+    {
+        std::vector<color>().swap(frame_buffer);
+        std::vector<int>().swap(sample_counts);
+        pixel_stats.clear();
+        target_samples = ctx.samples_per_pixel;
+        progress_total = std::max<uint64_t>(static_cast<uint64_t>(frame_width) * frame_height * ctx.samples_per_pixel, 1);
+
+        begin_stats();
+
+        for_each_tile(frame_width, frame_height, options.stream_tile_size, [&](int x0, int y0, int w, int h)
+                      {
+                          thread_sampler.use(pixel_sampler.get());
+
+                          std::vector<color> pixels(static_cast<size_t>(w) * h);
+                          for (int y = y0; y < y0 + h; y++)
+                          {
+                              for (int x = x0; x < x0 + w; x++)
+                              {
+                                  int m = y * frame_width + x;
+                                  auto sum = render_samples(ctx, x, frame_height - 1 - y, m, 0, ctx.samples_per_pixel);
+                                  pixels[(y - y0) * w + (x - x0)] = average_pixel(sum, ctx.samples_per_pixel);
+                              }
+                          }
+
+                          for (const auto &writer : options.tile_writers)
+                              writer->write_tile(x0, y0, w, h, pixels);
+
+                          flush_ray_count();
+                          report_progress(static_cast<uint64_t>(w) * h * ctx.samples_per_pixel); });
+
+        end_stats();
+        update_progress(1.0);
+    }
+
+    /**
+     * @brief 打开 tile_writers 中的文件，并决定本次渲染能否流式输出
+     */
+    void open_tile_writers(const frame_context &ctx)
+    {
+        streaming = !options.tile_writers.empty() && !options.adaptive && options.progressive_samples <= 0 &&
+                    options.checkpoint_file.empty() && !options.resume && options.time_budget <= 0;
+
+        for (const auto &writer : options.tile_writers)
+        {
+            if (!writer->open(ctx.image_width, ctx.image_height, options.stream_tile_size))
+                std::cerr << "failed to create " << writer->filename << "\n";
+        }
+    }
+
+    void close_tile_writers()
+    {
+        for (const auto &writer : options.tile_writers)
+        {
+            if (!writer->close())
+                std::cerr << "\nfailed to write " << writer->filename << "\n";
+        }
+    }
+
+    /**
+     * @brief 不能流式输出时，渲染结束后把 frame buffer 逐个 tile 写入 tile_writers
+     */
+    void write_frame_tiles()
+    {
+        for_each_tile(frame_width, frame_height, options.stream_tile_size, [&](int x0, int y0, int w, int h)
+                      {
+                          std::vector<color> pixels(static_cast<size_t>(w) * h);
+                          for (int y = 0; y < h; y++)
+                          {
+                              for (int x = 0; x < w; x++)
+                              {
+                                  size_t m = static_cast<size_t>(y0 + y) * frame_width + x0 + x;
+                                  pixels[y * w + x] = average_pixel(frame_buffer[m], sample_counts[m]);
+                              }
+                          }
+
+                          for (const auto &writer : options.tile_writers)
+                              writer->write_tile(x0, y0, w, h, pixels); });
+    }
+
+    /**
+     * @brief 限时渲染：先试渲染整幅画面，每一轮的采样数从 pilot_samples 开始加倍，直到试渲染用去预算的 2%；
+     * 每一轮都有固定的调度开销，因此以最后也是最大的一轮的耗时估计每个采样（整幅画面）的耗时，
+     * 预测截止时间前能达到的采样数。之后每一轮使用剩余时间内预计能完成的采样数的一半，并以该轮的耗时更新估计，
+     * 剩余时间不足一个采样时停止。估计偏低时 render_pixel 在截止时间到达时停止，未完成的像素按已有的采样数取平均
+     */
+    void render_budgeted(const frame_context &ctx)
+    {
+        std::vector<int> pass_samples(frame_buffer.size());
+        double seconds_per_sample = 0;
+        auto seconds_since = [](std::chrono::steady_clock::time_point t)
+        { return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count(); };
+
+        int pilot = std::max(options.pilot_samples, 1);
+        do
+        {
+            if (!timed_pass(ctx, pilot, pass_samples, seconds_per_sample))
+                return;
+
+            pilot *= 2;
+        } while (seconds_since(render_start) < 0.02 * options.time_budget);
+
+        // 构建场景已经用完了全部时间
+        if (seconds_per_sample <= 0)
+            return;
+
+        stats.pilot_seconds = seconds_since(render_start);
+        stats.pilot_rays_per_second = ray_counter.load() / stats.pilot_seconds;
+
+        double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+        double current = average_samples_per_pixel();
+        stats.predicted_samples_per_pixel =
+            std::min(current + std::floor(std::max(remaining, 0.0) / seconds_per_sample), 1.0 * ctx.samples_per_pixel);
+        stats.predicted_seconds = seconds_since(render_call_start) +
+                                  (stats.predicted_samples_per_pixel - current) * seconds_per_sample;
+
+        while (true)
+        {
+            remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+
+            int fit = static_cast<int>(remaining / seconds_per_sample);
+            if (fit < 1 || !timed_pass(ctx, std::max(fit / 2, 1), pass_samples, seconds_per_sample))
+                break;
+        }
+    }
+
+    /**
+     * @brief 为每个像素追加最多 batch 个采样，并由这一轮的耗时更新 seconds_per_sample
+     *
+     * @return 没有需要采样的像素时返回 false
+     */
+    bool timed_pass(const frame_context &ctx, int batch, std::vector<int> &pass_samples, double &seconds_per_sample)
+    {
+        if (!remaining_samples(ctx, batch, pass_samples))
+            return false;
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t samples_before = samples_done;
+
+        render_pass(ctx, pass_samples);
+        end_pass(false);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double samples_per_pixel = static_cast<double>(samples_done - samples_before) / frame_buffer.size();
+        if (samples_per_pixel > 0)
+            seconds_per_sample = seconds / samples_per_pixel;
+
+        return true;
+    }
+
+    double average_samples_per_pixel() const
+    {
+        double sum = 0;
+        for (auto count : sample_counts)
+            sum += count;
+        return sum / sample_counts.size();
+    }
+
+    /**
+     * @brief 自适应采样；每个像素的误差取 3x3 邻域内的最大值，避免初始采样恰好没有击中焦散等小而亮的区域时过早停止；
+     * 同时设置了 time_budget 时到达截止时间后停止
+     */
+    void render_adaptive(const frame_context &ctx)
+    {
+        int width = ctx.image_width, height = ctx.image_height;
+        int batch = std::max(1, std::min(options.adaptive_min_samples, ctx.samples_per_pixel));
+
+        std::vector<int> pass_samples(frame_buffer.size());
+        std::vector<double> error(frame_buffer.size());
+        if (!remaining_samples(ctx, batch, pass_samples))
+            return;
+
+        while (true)
+        {
+            uint64_t samples_before = samples_done;
+            render_pass(ctx, pass_samples);
+            end_pass(false);
+
+            // 设置了 time_budget 时，截止时间之后 render_pixel 不再追加采样，误差也不会再变化
+            if (samples_done == samples_before || (has_deadline && std::chrono::steady_clock::now() >= deadline))
+                break;
+
+            for (size_t m = 0; m < error.size(); m++)
+                error[m] = pixel_stats[m].display_error();
+
+            bool active = false;
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    double neighborhood_error = 0;
+                    for (int dy = std::max(y - 1, 0); dy <= std::min(y + 1, height - 1); dy++)
+                    {
+                        for (int dx = std::max(x - 1, 0); dx <= std::min(x + 1, width - 1); dx++)
+                            neighborhood_error = fmax(neighborhood_error, error[dy * width + dx]);
+                    }
+
+                    int m = y * width + x;
+                    int remaining = std::max(ctx.samples_per_pixel - sample_counts[m], 0);
+                    pass_samples[m] = neighborhood_error > options.adaptive_threshold ? std::min(batch, remaining) : 0;
+                    active = active || pass_samples[m] > 0;
+                }
+            }
+
+            if (!active)
+                break;
+        }
+    }
+
+    /**
+     * @brief 计算下一轮每个像素追加的采样数：最多 batch 个，且不超过 samples_per_pixel
+     *
+     * @return 还有像素需要采样时返回 true
+     */
+    bool remaining_samples(const frame_context &ctx, int batch, std::vector<int> &pass_samples) const
+    {
+        bool active = false;
+        for (size_t m = 0; m < pass_samples.size(); m++)
+        {
+            pass_samples[m] = std::min(batch, std::max(ctx.samples_per_pixel - sample_counts[m], 0));
+            active = active || pass_samples[m] > 0;
+        }
+
+        return active;
+    }
+
+    /**
+     * @brief 每一轮结束时调用；设置了检查点文件时，距上次保存超过 checkpoint_seconds 秒或渲染结束时保存检查点
+     */
+    void end_pass(bool finished)
+    {
+        if (options.checkpoint_file.empty())
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        if (!finished && std::chrono::duration<double>(now - last_checkpoint).count() < options.checkpoint_seconds)
+            return;
+
+        // 上次保存之后没有新的采样
+        if (checkpoint_samples == samples_done && samples_done > 0)
+            return;
+
+        render_checkpoint checkpoint;
+        checkpoint.image_width = frame_width;
+        checkpoint.image_height = frame_height;
+        checkpoint.scene_key = scene_key;
+        checkpoint.seed = options.seed;
+        checkpoint.sampler = checkpoint_sampler_type();
+        checkpoint.sampler_spp = static_cast<uint32_t>(sampler_spp);
+        checkpoint.sampler_key = pixel_sampler->key();
+        checkpoint.integrator = static_cast<uint32_t>(options.integrator);
+        checkpoint.accumulated = frame_buffer;
+        checkpoint.sample_counts = sample_counts;
+
+        if (!write_checkpoint(options.checkpoint_file, checkpoint))
+            std::cerr << "\nfailed to write checkpoint " << options.checkpoint_file << "\n";
+
+        last_checkpoint = now;
+        checkpoint_samples = samples_done;
+    }
+
+    /**
+     * @brief 从检查点恢复每个像素的采样之和与采样数；检查点的场景、分辨率、种子、采样器或积分器与当前渲染不同时
+     * 继续渲染会得到不一致的结果，此时忽略检查点重新开始。采样器按检查点中保存的采样数重新创建，
+     * 提高 samples_per_pixel 后追加的采样仍然是同一个序列的后续部分；使用 options.custom_sampler 时沿用该采样器，
+     * 两者都通过 sampler::key() 确认与保存检查点时的采样器相同。自适应采样的方差统计不保存在检查点中，
+     * 继续时重新累积
+     */
+    void load_checkpoint(const frame_context &ctx)
+    {
+        render_checkpoint checkpoint;
+        if (!read_checkpoint(options.checkpoint_file, checkpoint))
+            return;
+
+        auto resumed_sampler = options.custom_sampler
+                                   ? options.custom_sampler
+                                   : make_sampler(options.sampler, static_cast<int>(checkpoint.sampler_spp));
+
+        if (checkpoint.scene_key != scene_key ||
+            checkpoint.image_width != ctx.image_width || checkpoint.image_height != ctx.image_height ||
+            checkpoint.seed != options.seed || checkpoint.sampler != checkpoint_sampler_type() ||
+            checkpoint.sampler_key != resumed_sampler->key() ||
+            checkpoint.integrator != static_cast<uint32_t>(options.integrator))
+        {
+            std::cerr << "checkpoint " << options.checkpoint_file << " does not match the current render, ignored\n";
+            return;
+        }
+
+        frame_buffer = std::move(checkpoint.accumulated);
+        sample_counts = std::move(checkpoint.sample_counts);
+        sampler_spp = static_cast<int>(checkpoint.sampler_spp);
+        pixel_sampler = resumed_sampler;
+    }
+
+    /**
+     * @brief 检查点中记录的采样器类型
+     */
+    uint32_t checkpoint_sampler_type() const
+    {
+        return options.custom_sampler ? render_checkpoint::custom_sampler : static_cast<uint32_t>(options.sampler);
+    }
+
+    /**
+     * @brief 生成场景并构建加速结构，耗时单独记录在 stats.scene_seconds 中；
+     * 场景生成使用当前线程的随机数（如 random_scene 和 the_next_week_final_scene 中随机放置的物体），
+     * 生成前重置为固定的独立随机数序列，使每次渲染的场景相同，相同的 seed 得到相同的图像
+     *
+     * @param pool 不为空时在该线程池中并行构建 bvh
+     */
+    shared_ptr<hittable> build_world(const shared_ptr<scene_generator> &scene, thread_pool *pool = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        thread_sampler.use(nullptr);
+        thread_sampler.seed(0, 0);
+
+        scene->bvh_options.pool = pool;
+        auto world = scene->generate_bvh_scene(&stats.bvh);
+        scene->bvh_options.pool = nullptr;
+
+        stats.scene_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return world;
+    }
+
+    /**
+     * @brief 在渲染开始和结束时调用，用于统计射线数量和渲染耗时
+     */
+    void begin_stats()
+    {
+        ray_counter = 0;
+        thread_ray_count = 0;
+        samples_done = 0;
+        stats.pilot_seconds = 0;
+        stats.pilot_rays_per_second = 0;
+        stats.predicted_samples_per_pixel = 0;
+        stats.predicted_seconds = 0;
+        saved_closest_hit_counter = 0;
+        thread_saved_closest_hit_count = 0;
+        render_start = std::chrono::steady_clock::now();
+    }
+
+    void end_stats()
+    {
+        stats.rays = ray_counter.load();
+        stats.saved_closest_hits = saved_closest_hit_counter.load();
+        stats.samples = 0;
+        for (auto count : sample_counts)
+            stats.samples += count;
+        if (streaming)
+            stats.samples = samples_done;
+        stats.render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
+    }
+
+    /**
+     * @brief 按照 options 中选择的积分器计算一条相机射线带回的颜色
+     */
+    color trace(const ray &r, const color &background_color, const hittable &world,
+                const hittable *lights, int max_depth)
+    {
+        if (options.integrator == integrator_type::iterative)
+            return ray_color_iterative(r, background_color, world, lights, max_depth);
+        if (options.integrator == integrator_type::mis)
+            return ray_color_mis(r, background_color, world, lights, max_depth);
+
+        return ray_color(r, background_color, world, lights, max_depth);
+    }
+
+    /**
+     * @brief 为非镜面散射采样出射方向；有光源时以相同的概率混合光源采样和材质采样，
+     * 所有 pdf 都在栈上构造
+     *
+     * @param lights 用于重要性采样的光源，为 nullptr 时只按材质采样
+     * @param pdf_val 返回出射方向的概率密度
+     */
+    ray sample_scattered(const ray &r, const hit_record &rec, const scatter_record &srec,
+                         const hittable *lights, double &pdf_val) const
+    {
+        if (!lights)
+        {
+            thread_sampler.begin_phase(sample_phase::bsdf);
+            ray scattered(rec.p, srec.pdf.generate(), r.time());
+            pdf_val = srec.pdf.sample(scattered.direction());
+            return scattered;
+        }
+
+        hittable_pdf light_pdf(*lights, rec.p);
+        mixture_pdf p(&light_pdf, &srec.pdf);
+
+        // 与 mixture_pdf::generate 相同，但选择策略和生成方向分别使用各自的维度
+        thread_sampler.begin_phase(sample_phase::strategy);
+        bool use_light = random_double() < 0.5;
+        thread_sampler.begin_phase(sample_phase::bsdf);
+
+        ray scattered(rec.p, use_light ? light_pdf.generate() : srec.pdf.generate(), r.time());
+        pdf_val = p.sample(scattered.direction());
+        return scattered;
+    }
+
+    /**
+     * @brief 在渲染开始前准备用于重要性采样的光源；场景没有提供光源时返回 nullptr，
+     * 此时不对光源进行重要性采样；按功率选择光源时在这里构建 light_sampler
+     */
+    shared_ptr<hittable> light_set(const shared_ptr<hittable> &lights) const
+    {
+        auto list = std::dynamic_pointer_cast<hittable_list>(lights);
+        if (!lights || (list && list->objects.empty()))
+            return nullptr;
+
+        if (list && options.light_selection == light_selection_type::power)
+            return make_shared<light_sampler>(*list);
+        if (list && options.light_selection == light_selection_type::bvh)
+            return make_shared<light_bvh>(*list);
+
+        return lights;
+    }
 
     color ray_color(const ray &r, const color &background_color, const hittable &world,
-                    const shared_ptr<hittable> &lights, int depth)
+                    const hittable *lights, int depth)
     {
         if (depth <= 0)
             return color(0);
 
         // 如果射线没击中任何物体，则返回背景色
+        thread_sampler.begin_bounce();
         hit_record rec;
+        thread_ray_count++;
         if (!world.hit(r, 0.001, infinity, rec))
             return background_color;
 
         scatter_record srec;
-        color emitted = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
-        if (!rec.mat->scatter(r, rec, srec))
+        color emission = emitted(*rec.mat, r, rec);
+        thread_sampler.begin_phase(sample_phase::scatter);
+        if (!scatter(*rec.mat, r, rec, srec))
         {
-            return emitted;
+            return emission;
         }
 
         if (srec.is_specular)
@@ -47,144 +822,338 @@ protected:
             return srec.attenuation * ray_color(srec.specular_ray, background_color, world, lights, depth - 1);
         }
 
-        auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+        double pdf_val;
+        ray scattered = sample_scattered(r, rec, srec, lights, pdf_val);
+
+        auto attenuation = srec.attenuation * scattering_pdf(*rec.mat, r, rec, scattered);
+        return emission + attenuation * ray_color(scattered, background_color, world, lights, depth - 1) / pdf_val;
+    }
+
+    /**
+     * @brief 与 ray_color 等价的循环版本；throughput 记录路径上已经累积的衰减，
+     * 从第 russian_roulette_depth 次弹射开始，以 throughput 的最大分量作为继续的概率，
+     * 继续时除以该概率以保持估计无偏
+     */
+    color ray_color_iterative(const ray &camera_ray, const color &background_color, const hittable &world,
+                              const hittable *lights, int max_depth)
+    {
+        color radiance(0);
+        color throughput(1);
+        ray r = camera_ray;
+
+        for (int depth = 0; depth < max_depth; depth++)
+        {
+            thread_sampler.begin_bounce();
+            hit_record rec;
+            thread_ray_count++;
+            if (!world.hit(r, 0.001, infinity, rec))
+            {
+                radiance += throughput * background_color;
+                break;
+            }
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
-        auto pdf_val = p.sample(scattered.direction());
+            scatter_record srec;
+            radiance += throughput * emitted(*rec.mat, r, rec);
+            thread_sampler.begin_phase(sample_phase::scatter);
+            if (!scatter(*rec.mat, r, rec, srec))
+                break;
 
-        auto attenuation = srec.attenuation * rec.mat->scattering_pdf(r, rec, scattered);
-        return emitted + attenuation * ray_color(scattered, background_color, world, lights, depth - 1) / pdf_val;
+            if (srec.is_specular)
+            {
+                throughput = throughput * srec.attenuation;
+                r = srec.specular_ray;
+            }
+            else
+            {
+                double pdf_val;
+                ray scattered = sample_scattered(r, rec, srec, lights, pdf_val);
+
+                throughput = throughput * srec.attenuation * scattering_pdf(*rec.mat, r, rec, scattered) / pdf_val;
+                r = scattered;
+            }
+
+            if (depth + 1 >= options.russian_roulette_depth)
+            {
+                thread_sampler.begin_phase(sample_phase::russian_roulette);
+                auto survive = fmin(fmax(throughput.x(), fmax(throughput.y(), throughput.z())), 0.95);
+                if (random_double() >= survive)
+                    break;
+
+                throughput /= survive;
+            }
+        }
+
+        return radiance;
+    }
+
+    /**
+     * @brief 多重重要性采样的积分器；每次非镜面散射时按光源采样一个方向并立即计算其直接光照（next event estimation），
+     * 再按材质采样一个方向作为路径的下一段。两种策略都可能得到同一个击中光源的方向，
+     * 各自的贡献乘以 mis_weight 计算的权重，权重之和为 1，因此估计仍然无偏
+     *
+     * 路径长度的限制和俄罗斯轮盘赌与 ray_color_iterative 相同
+     */
+    color ray_color_mis(const ray &camera_ray, const color &background_color, const hittable &world,
+                        const hittable *lights, int max_depth)
+    {
+        color radiance(0);
+        color throughput(1);
+        ray r = camera_ray;
+        point3 last_p;
+        double bsdf_pdf = 0; // 上一次按材质采样的 pdf；为 0 时表示相机射线或镜面散射，击中光源时不需要加权
+
+        for (int depth = 0; depth < max_depth; depth++)
+        {
+            thread_sampler.begin_bounce();
+            hit_record rec;
+            thread_ray_count++;
+            if (!world.hit(r, 0.001, infinity, rec))
+            {
+                radiance += throughput * background_color;
+                break;
+            }
+
+            color emission = emitted(*rec.mat, r, rec);
+            if (bsdf_pdf > 0 && lights && !emission.near_zero())
+                emission *= mis_weight(bsdf_pdf, lights->pdf_value(last_p, r.direction()));
+            radiance += throughput * emission;
+
+            scatter_record srec;
+            thread_sampler.begin_phase(sample_phase::scatter);
+            if (!scatter(*rec.mat, r, rec, srec))
+                break;
+
+            if (srec.is_specular)
+            {
+                throughput = throughput * srec.attenuation;
+                r = srec.specular_ray;
+                bsdf_pdf = 0;
+            }
+            else
+            {
+                // 光源上的点与当前点之间多了一次弹射，路径长度达到上限时不再计算直接光照
+                if (lights && depth + 1 < max_depth)
+                    radiance += throughput * sample_light(r, rec, srec, world, *lights);
+
+                thread_sampler.begin_phase(sample_phase::bsdf);
+                ray scattered(rec.p, srec.pdf.generate(), r.time());
+                bsdf_pdf = srec.pdf.sample(scattered.direction());
+                if (bsdf_pdf <= 0)
+                    break;
+
+                throughput = throughput * srec.attenuation * scattering_pdf(*rec.mat, r, rec, scattered) / bsdf_pdf;
+                last_p = rec.p;
+                r = scattered;
+            }
+
+            if (depth + 1 >= options.russian_roulette_depth)
+            {
+                thread_sampler.begin_phase(sample_phase::russian_roulette);
+                auto survive = fmin(fmax(throughput.x(), fmax(throughput.y(), throughput.z())), 0.95);
+                if (random_double() >= survive)
+                    break;
+
+                throughput /= survive;
+            }
+        }
+
+        return radiance;
+    }
+
+    /**
+     * @brief 按光源采样一个点，返回该点的直接光照乘以材质衰减和 MIS 权重；
+     * 辐射亮度取自光源自身的交点记录，可见性只需要用 any_hit_query 检查着色点与采样点之间是否有遮挡
+     */
+    color sample_light(const ray &r, const hit_record &rec, const scatter_record &srec,
+                       const hittable &world, const hittable &lights)
+    {
+        thread_sampler.begin_phase(sample_phase::light);
+        ray to_light;
+        hit_record light_rec;
+        if (!lights.sample_point(rec.p, r.time(), to_light, light_rec))
+            return color(0);
+
+        auto light_pdf = lights.pdf_value(rec.p, to_light.direction());
+        if (light_pdf <= 0)
+            return color(0);
+
+        auto scattering = scattering_pdf(*rec.mat, r, rec, to_light);
+        if (scattering <= 0)
+            return color(0);
+
+        auto emission = emitted(*light_rec.mat, to_light, light_rec);
+        if (emission.near_zero())
+            return color(0);
+
+        // 光源本身也在场景中，查询范围在采样点之前略微缩短，不会与光源表面相交
+        thread_ray_count++;
+        if (any_hit_query(world, to_light, 0.001, light_rec.t * (1 - 1e-4)))
+            return color(0);
+
+        auto weight = mis_weight(light_pdf, srec.pdf.sample(to_light.direction()));
+        return emission * srec.attenuation * (scattering * weight / light_pdf);
+    }
+
+    /**
+     * @brief 以 pdf_a 采样得到的贡献在与 pdf_b 合并时的权重
+     */
+    double mis_weight(double pdf_a, double pdf_b) const
+    {
+        if (options.heuristic == mis_heuristic::balance)
+            return pdf_a / (pdf_a + pdf_b);
+
+        return pdf_a * pdf_a / (pdf_a * pdf_a + pdf_b * pdf_b);
+    }
+
+    /**
+     * @brief 将当前线程统计的射线数量和节省的最近交点查询次数汇总到 stats 中
+     */
+    void flush_ray_count()
+    {
+        ray_counter.fetch_add(thread_ray_count, std::memory_order_relaxed);
+        thread_ray_count = 0;
+        saved_closest_hit_counter.fetch_add(thread_saved_closest_hit_count, std::memory_order_relaxed);
+        thread_saved_closest_hit_count = 0;
     }
 
+    /**
+     * @brief 记录新完成的采样数并输出进度，可以在多个线程中同时调用
+     */
+    void report_progress(uint64_t samples)
+    {
+        auto done = samples_done.fetch_add(samples) + samples;
+
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        update_progress(1.0 * done / progress_total);
+    }
+
+    std::chrono::steady_clock::time_point render_start;
+    std::chrono::steady_clock::time_point render_call_start; // 调用 render 的时间，限时渲染从这里开始计时
+    std::chrono::steady_clock::time_point deadline;
+    bool has_deadline = false;
+    std::chrono::steady_clock::time_point last_checkpoint;
+    uint64_t checkpoint_samples = 0; // 上次保存检查点时的 samples_done
+    std::atomic<uint64_t> samples_done{0};
+    uint64_t progress_total = 1; // 本次渲染最多追加的采样数；自适应采样提前结束时进度直接跳到 100%
+    std::mutex progress_mutex;
+
     void update_progress(double progress)
     {
+        if (!options.show_progress)
+            return;
+
         std::cerr << "\rRendering: " << progress * 100.0 << " %" << std::flush;
     }
 };
 
+/**
+ * @brief 多线程渲染器；画面被切分为固定大小的小块（tile），由常驻线程池中的
+ * 工作线程通过工作窃取的方式领取，线程数量与 tile 数量相互独立
+ */
 class multi_thread_renderer : public renderer
 {
 public:
-    multi_thread_renderer(int batch_x, int batch_y)
-        : batch_x(batch_x), batch_y(batch_y)
+    /**
+     * @param thread_count 渲染线程数量，小于等于 0 时使用硬件线程数
+     * @param tile_size tile 的边长（像素）
+     */
+    multi_thread_renderer(int thread_count = 0, int tile_size = 32)
+        : pool(thread_count), tile_size(tile_size)
     {
     }
 
-    virtual void render(const shared_ptr<scene_generator> &scene, const shared_ptr<hittable> &lights) override
+protected:
+    virtual void render_pass(const frame_context &ctx, const std::vector<int> &pass_samples) override
     {
-        int image_width = scene->image_width;
-        int image_height = scene->image_height;
-        int samples_per_pixel = scene->samples_per_pixel;
-        int max_depth = scene->max_depth;
-        color background_color = scene->background_color;
-
-        bvh_node world = scene->generate_bvh_scene();
-        camera cam = scene->get_camera();
+        int image_width = ctx.image_width;
+        int image_height = ctx.image_height;
 
-        frame_buffer = std::vector<color>(image_height * image_width);
-
-        int progress = 0;
-        auto subRenderThread = [&](int rowStart, int rowEnd, int colStart, int colEnd)
+        auto render_tile = [&](int x0, int x1, int y0, int y1)
         {
-            for (int j = colStart; j < colEnd; j++)
+            thread_sampler.use(pixel_sampler.get());
+
+            uint64_t samples = 0;
+            for (int j = y0; j < y1; j++)
             {
                 // 计算当前像素在 frame buffer 中的索引
-                int m = (image_height - 1 - j) * image_width + rowStart;
+                int m = (image_height - 1 - j) * image_width + x0;
 
-                for (int i = rowStart; i < rowEnd; i++)
+                for (int i = x0; i < x1; i++, m++)
                 {
-                    color pixel_color(0, 0, 0);
+                    if (pass_samples[m] <= 0)
+                        continue;
 
-                    for (int s = 0; s < samples_per_pixel; s++)
-                    {
-                        auto u = (i + random_double()) / (image_width - 1);
-                        auto v = (j + random_double()) / (image_height - 1);
-                        ray r = cam.get_ray(u, v);
-
-                        pixel_color += ray_color(r, background_color, world, lights, max_depth);
-                    }
-
-                    frame_buffer[m++] = pixel_color;
-                    progress++;
+                    samples += render_pixel(ctx, i, j, m, pass_samples[m]);
                 }
-
-                std::lock_guard<std::mutex> g1(mutex_ins);
-                update_progress(1.0 * progress / image_width / image_height);
             }
-        };
 
-        int stride_x = int(ceil((double)image_width / batch_x));
-        int stride_y = int(ceil((double)image_height / batch_y));
-        std::vector<std::thread> render_threads;
+            flush_ray_count();
+            report_progress(samples);
+        };
 
-        for (int j = 0, index = 0; j < image_height; j += stride_y)
+        // 从画面顶部开始逐行切分 tile，提交顺序即大致的渲染顺序
+        for (int y1 = image_height; y1 > 0; y1 -= tile_size)
         {
-            for (int i = 0; i < image_width; i += stride_x, index++)
+            int y0 = std::max(0, y1 - tile_size);
+
+            for (int x0 = 0; x0 < image_width; x0 += tile_size)
             {
-                uint32_t rowStart = i;
-                uint32_t rowEnd = std::min(i + stride_x, image_width);
-                uint32_t colStart = j;
-                uint32_t colEnd = std::min(j + stride_y, image_height);
+                int x1 = std::min(x0 + tile_size, image_width);
 
-                render_threads.push_back(std::thread(subRenderThread, rowStart, rowEnd, colStart, colEnd));
+                pool.submit([=, &render_tile](int)
+                            { render_tile(x0, x1, y0, y1); });
             }
         }
 
-        for (int i = 0; i < batch_x * batch_y; i++)
+        pool.wait_idle();
+    }
+
+    virtual thread_pool *worker_pool() override { return &pool; }
+
+    virtual void for_each_tile(int width, int height, int tile_size,
+                               const std::function<void(int, int, int, int)> &render_tile) override
+    {
+        for (int y0 = 0; y0 < height; y0 += tile_size)
         {
-            render_threads[i].join();
+            for (int x0 = 0; x0 < width; x0 += tile_size)
+            {
+                int w = std::min(tile_size, width - x0);
+                int h = std::min(tile_size, height - y0);
+                pool.submit([=, &render_tile](int)
+                            { render_tile(x0, y0, w, h); });
+            }
         }
 
-        update_progress(1.0);
+        pool.wait_idle();
     }
 
 private:
-    const int batch_x;
-    const int batch_y;
-
-    std::mutex mutex_ins;
+    thread_pool pool;
+    const int tile_size;
 };
 
 class single_thread_renderer : public renderer
 {
-public:
-    virtual void render(const shared_ptr<scene_generator> &scene, const shared_ptr<hittable> &lights) override
+protected:
+    virtual void render_pass(const frame_context &ctx, const std::vector<int> &pass_samples) override
     {
-        int image_width = scene->image_width;
-        int image_height = scene->image_height;
-        int samples_per_pixel = scene->samples_per_pixel;
-        int max_depth = scene->max_depth;
-        color background_color = scene->background_color;
-
-        bvh_node world = scene->generate_bvh_scene();
-        camera cam = scene->get_camera();
-
-        frame_buffer = std::vector<color>(image_height * image_width);
+        thread_sampler.use(pixel_sampler.get());
 
-        int progress = 0;
-        for (int j = image_height - 1, m = 0; j >= 0; j--)
+        for (int j = ctx.image_height - 1, m = 0; j >= 0; j--)
         {
-            for (int i = 0; i < image_width; i++, m++)
+            uint64_t samples = 0;
+            for (int i = 0; i < ctx.image_width; i++, m++)
             {
-                color pixel_color(0, 0, 0);
+                if (pass_samples[m] <= 0)
+                    continue;
 
-                for (int s = 0; s < samples_per_pixel; s++)
-                {
-                    auto u = (i + random_double()) / (image_width - 1);
-                    auto v = (j + random_double()) / (image_height - 1);
-                    ray r = cam.get_ray(u, v);
-                    pixel_color += ray_color(r, background_color, world, lights, max_depth);
-                }
-
-                frame_buffer[m] = pixel_color;
-                progress++;
+                samples += render_pixel(ctx, i, j, m, pass_samples[m]);
             }
 
-            update_progress(1.0 * progress / image_width / image_height);
+            report_progress(samples);
         }
 
-        update_progress(1.0);
+        flush_ray_count();
     }
 };
 
@@ -4,7 +4,9 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
+
+#include "sampler.h"
+#include "cpu_dispatch.h"
 
 // Usings
 
@@ -12,6 +14,14 @@ using std::make_shared;
 using std::shared_ptr;
 using std::sqrt;
 
+// 标量类型；定义 RTW_USE_FLOAT 时 vec3、ray、aabb 和 hit_record 使用单精度浮点数
+
+#ifdef RTW_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -34,13 +44,11 @@ inline double clamp(double x, double min, double max)
 }
 
 /**
- * @brief 返回一个范围在 [0, 1) 内的随机数
+ * @brief 返回一个范围在 [0, 1) 内的随机数，取自当前线程的随机数序列
  */
 inline double random_double()
 {
-    static std::mt19937 generator;
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    return distribution(generator);
+    return thread_sampler.next_double();
 }
 
 /**
@@ -0,0 +1,435 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+
+#include "random.h"
+
+/**
+ * @brief 采样器类型；除 independent 外都是低差异序列，同一像素的各个采样在每一维上分布得更均匀
+ */
+enum class sampler_type
+{
+    independent, // 每一维都是独立的随机数
+    stratified,  // 每两维一组，在 spp 个格子组成的网格中各取一个格子并在格子内抖动
+    halton,      // Halton 序列，每一维以一个质数为底，按像素对每一位数字随机置换
+    sobol,       // Owen 扰乱的 Sobol 序列，每两维一组，组内为 (0, 2) 序列，各组的采样顺序独立打乱
+};
+
+/**
+ * @brief 一条路径上使用随机数的各个阶段；每个阶段占用固定的一段维度，
+ * 使不同采样在同一阶段得到的是低差异序列中的同一维，而不是因为前面消耗的随机数数量不同而错位
+ */
+enum class sample_phase
+{
+    pixel,            // 像素内的位置，2 维
+    lens,             // 镜头上的位置，2 维
+    time,             // 快门时间，1 维
+    intersect,        // 求交（体积中的散射距离），1 维
+    light,            // 选择光源 1 维 + 光源上的点 2 维
+    scatter,          // 材质内部的随机选择（反射或折射、模糊反射），2 维
+    strategy,         // 选择按光源还是按材质采样，1 维
+    russian_roulette, // 俄罗斯轮盘赌，1 维
+    bsdf,             // 散射方向，2 维
+};
+
+/**
+ * @brief 一个采样在序列中的位置，由 sampler_state::seed 根据像素和采样序号计算
+ */
+struct sample_index
+{
+    uint64_t pixel_key = 0;  // 只由像素决定，用于低差异序列的扰乱，同一像素的所有采样相同
+    uint64_t sample_key = 0; // 由像素和采样序号决定，用于独立随机数
+    uint32_t sample = 0;     // 像素内的采样序号
+};
+
+/**
+ * @brief 采样器接口，给出第 s 个采样在第 d 维的值；采样器只保存构造时确定的参数，
+ * 可以被所有渲染线程共享，逐个采样推进维度的状态保存在每个线程的 sampler_state 中
+ */
+class sampler
+{
+public:
+    virtual ~sampler() {}
+
+    /**
+     * @brief 返回一个范围在 [0, 1) 内的值
+     */
+    virtual double get(const sample_index &s, uint32_t d) const = 0;
+
+    /**
+     * @brief 区分采样器及其参数的键，保存在检查点中，继续渲染时键不同则忽略检查点；
+     * 默认只由实际类型的名称决定，带参数的采样器需要把参数也计入
+     */
+    virtual uint64_t key() const
+    {
+        uint64_t key = 0xcbf29ce484222325ull;
+        for (const char *c = typeid(*this).name(); *c; c++)
+            key = (key ^ static_cast<unsigned char>(*c)) * 0x100000001b3ull;
+        return key;
+    }
+
+    /**
+     * @brief 由采样和维度决定的独立随机数
+     */
+    static double independent(const sample_index &s, uint32_t d)
+    {
+        return to_double(counter_rng::mix(s.sample_key + (static_cast<uint64_t>(d) + 1) * 0x9e3779b97f4a7c15ull));
+    }
+
+    static double to_double(uint64_t x)
+    {
+        return static_cast<double>(x >> 11) * 0x1.0p-53;
+    }
+
+protected:
+    /**
+     * @brief 由 p 决定的 [0, l) 上的随机置换中第 i 个元素，不需要保存置换表（Kensler 2013）
+     */
+    static uint32_t permutation_element(uint32_t i, uint32_t l, uint32_t p)
+    {
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do
+        {
+            i ^= p;
+            i *= 0xe170893du;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3fu;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69u;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303u;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3dfu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+
+    static double clamp_below_one(double x)
+    {
+        return x < 1.0 ? x : 0x1.fffffffffffffp-1;
+    }
+};
+
+/**
+ * @brief 每一维都是独立的随机数
+ */
+class independent_sampler : public sampler
+{
+public:
+    virtual double get(const sample_index &s, uint32_t d) const override
+    {
+        return independent(s, d);
+    }
+};
+
+/**
+ * @brief 分层采样：每两维一组，在 spp 个格子组成的网格中各取一个格子并在格子内抖动
+ */
+class stratified_sampler : public sampler
+{
+public:
+    /**
+     * @param samples_per_pixel 每个像素的采样数，按它划分网格
+     */
+    explicit stratified_sampler(int samples_per_pixel)
+    {
+        spp = samples_per_pixel > 0 ? static_cast<uint32_t>(samples_per_pixel) : 1;
+        grid_x = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(spp))));
+        grid_y = (spp + grid_x - 1) / grid_x;
+    }
+
+    /**
+     * @brief 第 d / 2 组的二维抖动网格；每 spp 个采样为一轮，每轮随机选择 spp 个不同的格子，
+     * 格子数多于 spp 时每个采样落在任一格子中的概率仍然相同，因此每个采样都是均匀分布的
+     */
+    virtual double get(const sample_index &s, uint32_t d) const override
+    {
+        uint32_t round = s.sample / spp;
+        uint32_t index = s.sample % spp;
+        auto key = counter_rng::mix(s.pixel_key ^ counter_rng::mix((static_cast<uint64_t>(d / 2) << 32) | round));
+        uint32_t cell = permutation_element(index, grid_x * grid_y, static_cast<uint32_t>(key));
+
+        double jitter = independent(s, d);
+        if (d % 2 == 0)
+            return (cell % grid_x + jitter) / grid_x;
+        return (cell / grid_x + jitter) / grid_y;
+    }
+
+    virtual uint64_t key() const override
+    {
+        return counter_rng::mix(sampler::key() + spp);
+    }
+
+private:
+    uint32_t spp;
+    uint32_t grid_x, grid_y;
+};
+
+/**
+ * @brief Halton 序列，每一维以一个质数为底，按像素对每一位数字随机置换；超过 halton_dimensions 的维度使用独立随机数
+ */
+class halton_sampler : public sampler
+{
+public:
+    /**
+     * @param samples_per_pixel 每个像素的采样数，决定至少置换的位数
+     */
+    explicit halton_sampler(int samples_per_pixel)
+        : spp(samples_per_pixel > 0 ? static_cast<uint32_t>(samples_per_pixel) : 1)
+    {
+    }
+
+    /**
+     * @brief 以第 d 个质数为底的根式反演；每一位数字按由像素、维度和位数决定的随机置换重新排列，
+     * 最后一位以下以随机数填充，不改变各个采样所在的格子
+     */
+    virtual double get(const sample_index &s, uint32_t d) const override
+    {
+        if (d >= halton_dimensions)
+            return independent(s, d);
+
+        static constexpr uint32_t primes[halton_dimensions] = {
+            2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+            59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+            137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+            227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311};
+
+        uint32_t b = primes[d];
+        auto key = counter_rng::mix(s.pixel_key + (static_cast<uint64_t>(d) + 1) * 0xd1b54a32d192ed03ull);
+
+        // 至少处理到能区分前 spp 个采样的位数，同一轮中的采样高位的 0 也经过相同的置换
+        double inv_base = 1.0 / b, scale = inv_base, result = 0;
+        uint32_t index = s.sample;
+        uint64_t covered = 1;
+        for (uint32_t digit = 0; index > 0 || covered < spp; digit++, covered *= b)
+        {
+            auto p = static_cast<uint32_t>(counter_rng::mix(key + digit));
+            result += permutation_element(index % b, b, p) * scale;
+            index /= b;
+            scale *= inv_base;
+        }
+
+        return clamp_below_one(result + independent(s, d) * scale * b);
+    }
+
+    virtual uint64_t key() const override
+    {
+        return counter_rng::mix(sampler::key() + spp);
+    }
+
+    static constexpr int halton_dimensions = 64;
+
+private:
+    uint32_t spp;
+};
+
+/**
+ * @brief Owen 扰乱的 Sobol 序列，每两维一组，组内为 (0, 2) 序列，各组的采样顺序独立打乱
+ */
+class sobol_sampler : public sampler
+{
+public:
+    /**
+     * @brief 第 d / 2 组二维 Sobol 序列的第 d % 2 维；采样序号先经过嵌套均匀扰乱（Owen scrambling）打乱顺序，
+     * 各组的打乱方式不同，使各组之间互不相关，再对坐标进行 Owen 扰乱；
+     * 扰乱使用 Burley 2020 中基于哈希的 Laine-Karras 置换
+     */
+    virtual double get(const sample_index &s, uint32_t d) const override
+    {
+        auto key = counter_rng::mix(s.pixel_key + (static_cast<uint64_t>(d / 2) + 1) * 0xd1b54a32d192ed03ull);
+        uint32_t index = nested_uniform_scramble(s.sample, static_cast<uint32_t>(key));
+
+        uint32_t value;
+        if (d % 2 == 0)
+        {
+            // 第 0 维即以 2 为底的根式反演
+            value = reverse_bits(index);
+        }
+        else
+        {
+            value = 0;
+            for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+            {
+                if (index & 1)
+                    value ^= v;
+            }
+        }
+
+        value = nested_uniform_scramble(value, static_cast<uint32_t>(key >> 32) + d % 2);
+        return value * 0x1.0p-32;
+    }
+
+private:
+    static uint32_t reverse_bits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    /**
+     * @brief 只向高位传播的哈希，与位反转组合后即为对二进制小数的嵌套均匀扰乱
+     */
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+    {
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+};
+
+/**
+ * @brief 按类型创建采样器；分层采样和 Halton 序列按 samples_per_pixel 确定参数
+ */
+inline std::shared_ptr<sampler> make_sampler(sampler_type type, int samples_per_pixel)
+{
+    switch (type)
+    {
+    case sampler_type::stratified:
+        return std::make_shared<stratified_sampler>(samples_per_pixel);
+    case sampler_type::halton:
+        return std::make_shared<halton_sampler>(samples_per_pixel);
+    case sampler_type::sobol:
+        return std::make_shared<sobol_sampler>();
+    default:
+        return std::make_shared<independent_sampler>();
+    }
+}
+
+/**
+ * @brief 采样器在一个线程中的状态；第 d 维的值只由 (像素, 采样序号, d) 决定，
+ * 因此与 counter_rng 一样，渲染结果与线程数量和调度顺序无关
+ *
+ * 每个阶段开始时调用 begin_phase 跳转到该阶段的维度，阶段内的前 width 个随机数取自采样器，
+ * 超出的部分（如拒绝采样的重试）使用由 (阶段起始维度, 序号) 哈希得到的独立随机数，不会与其它阶段重复；
+ * 每次弹射开始时调用 begin_bounce，各次弹射使用互不重叠的维度
+ */
+class sampler_state
+{
+public:
+    static constexpr uint32_t camera_dimensions = 6;  // 相机使用的维度，补齐到偶数使每次弹射从偶数维开始
+    static constexpr uint32_t bounce_dimensions = 10; // 每次弹射使用的维度
+
+    /**
+     * @brief 设置之后的采样使用的采样器，由调用者保证其在使用期间有效；为空时使用独立随机数
+     */
+    void use(const sampler *s)
+    {
+        source = s;
+    }
+
+    /**
+     * @brief 切换到指定像素、指定采样，并从 pixel 阶段开始
+     *
+     * @param stream 全局种子，不同的 stream 得到互不相关的整幅图像的随机数
+     */
+    void seed(uint64_t pixel_index, uint64_t sample_index, uint64_t stream = 0)
+    {
+        index.pixel_key = counter_rng::mix(counter_rng::mix(stream) + pixel_index + 0x9e3779b97f4a7c15ull);
+        index.sample_key = counter_rng::mix(index.pixel_key ^ sample_index);
+        index.sample = static_cast<uint32_t>(sample_index);
+        bounce = 0;
+        base = 0;
+        begin_phase(sample_phase::pixel);
+    }
+
+    /**
+     * @brief 开始新的一次弹射，并进入 intersect 阶段
+     */
+    void begin_bounce()
+    {
+        base = camera_dimensions + bounce++ * bounce_dimensions;
+        begin_phase(sample_phase::intersect);
+    }
+
+    void begin_phase(sample_phase phase)
+    {
+        switch (phase)
+        {
+        case sample_phase::pixel:
+            return start(0, 2);
+        case sample_phase::lens:
+            return start(2, 2);
+        case sample_phase::time:
+            return start(4, 1);
+        case sample_phase::intersect:
+            return start(base, 1);
+        case sample_phase::light:
+            return start(base + 1, 3);
+        case sample_phase::scatter:
+            return start(base + 4, 2);
+        case sample_phase::strategy:
+            return start(base + 6, 1);
+        case sample_phase::russian_roulette:
+            return start(base + 7, 1);
+        case sample_phase::bsdf:
+            return start(base + 8, 2);
+        }
+    }
+
+    /**
+     * @brief 返回一个范围在 [0, 1) 内的随机数
+     */
+    double next_double()
+    {
+        uint32_t n = count++;
+        if (n >= width)
+            return sampler::to_double(counter_rng::mix(index.sample_key ^ counter_rng::mix((static_cast<uint64_t>(dimension) << 32) | n)));
+
+        if (!source)
+            return sampler::independent(index, dimension + n);
+        return source->get(index, dimension + n);
+    }
+
+private:
+    const sampler *source = nullptr;
+    sample_index index;
+
+    uint32_t bounce = 0;
+    uint32_t base = 0;      // 当前弹射的起始维度
+    uint32_t dimension = 0; // 当前阶段的起始维度
+    uint32_t width = 0;     // 当前阶段可用的维度数
+    uint32_t count = 0;     // 当前阶段已经消耗的随机数数量
+
+    void start(uint32_t first, uint32_t size)
+    {
+        dimension = first;
+        width = size;
+        count = 0;
+    }
+};
+
+/**
+ * @brief 每个线程独立的采样器状态；渲染器在每个 tile 开始前调用 use() 设置采样器，在每个采样开始前调用 seed() 切换序列
+ */
+inline thread_local sampler_state thread_sampler;
+
+#endif
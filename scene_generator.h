@@ -2,6 +2,7 @@
 #define SCENE_GENERATOR_H
 
 #include <string>
+#include <vector>
 
 #include "rtweekend.h"
 #include "sphere.h"
@@ -14,7 +15,11 @@
 #include "material.h"
 #include "camera.h"
 #include "mesh.h"
+#include "instance.h"
 #include "bvh.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+#include "compiled_scene.h"
 
 class scene_generator
 {
@@ -38,9 +43,31 @@ public:
         return camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, dist_to_focus, 0.0, 1.0);
     }
 
-    bvh_node generate_bvh_scene() const
+    bvh_layout layout = bvh_layout::linear;
+    bvh_build_options bvh_options; // 场景中所有 bvh 的构建选项，渲染器会在构建期间设置 pool
+    bool compiled = false;         // 为 true 时顶层使用按类型存放物体、不经过虚函数求交的 compiled_scene，忽略 layout
+
+    /**
+     * @brief 生成场景并按 layout 构建顶层加速结构
+     *
+     * @param stats 不为空时用于保存顶层 bvh 的构建统计信息
+     */
+    shared_ptr<hittable> generate_bvh_scene(bvh_build_stats *stats = nullptr) const
     {
-        return bvh_node(generate(), 0.0, 1.0);
+        if (compiled)
+            return make_shared<compiled_scene>(generate(), 0.0, 1.0, bvh_options, stats);
+
+        switch (layout)
+        {
+        case bvh_layout::binary:
+            return make_shared<bvh_node>(generate(), 0.0, 1.0, bvh_options, stats);
+        case bvh_layout::wide4:
+            return make_shared<wide_bvh<4>>(generate(), 0.0, 1.0, bvh_options, stats);
+        case bvh_layout::wide8:
+            return make_shared<wide_bvh<8>>(generate(), 0.0, 1.0, bvh_options, stats);
+        default:
+            return make_shared<linear_bvh>(generate(), 0.0, 1.0, bvh_options, stats);
+        }
     }
 
     virtual std::string output_filename() const = 0;
@@ -84,7 +111,7 @@ public:
 
         auto tex = make_shared<image_texture>("../../res/earthmap.jpg");
         auto mat = make_shared<lambertian>(tex);
-        world.add(make_shared<mesh>("../../res/bunny.obj", mat));
+        world.add(make_shared<mesh>("../../res/bunny.obj", mat, 1.0f, bvh_layout::linear, bvh_options));
 
         auto light_mat = make_shared<diffuse_light>(color(4, 4, 4));
         world.add(make_shared<sphere>(point3(0, 5, 5), 1, light_mat));
@@ -308,7 +335,8 @@ public:
     virtual shared_ptr<hittable_list> lights() const override
     {
         auto lights = make_shared<hittable_list>();
-        lights->add(make_shared<xz_rect>(213, 343, 227, 332, 554, make_shared<material>()));
+        // 与场景中的灯光相同，光源采样时使用光源自身的交点记录计算辐射亮度，朝下的一面才发光
+        lights->add(make_shared<flip_face>(make_shared<xz_rect>(213, 343, 227, 332, 554, make_shared<diffuse_light>(color(15, 15, 15)))));
 
         return lights;
     }
@@ -341,7 +369,7 @@ public:
 
         // 前面的盒子
         shared_ptr<material> aluminum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
-        shared_ptr<hittable> model = make_shared<mesh>("../../res/bunny.obj", aluminum, 2000.0f);
+        shared_ptr<hittable> model = make_shared<mesh>("../../res/bunny.obj", aluminum, 2000.0f, bvh_layout::linear, bvh_options);
         model = make_shared<rotate_y>(model, 180);
         model = make_shared<translate>(model, vec3(220, 0, 295));
         objects.add(model);
@@ -425,7 +453,7 @@ public:
     virtual shared_ptr<hittable_list> lights() const override
     {
         auto lights = make_shared<hittable_list>();
-        lights->add(make_shared<xz_rect>(123, 423, 147, 412, 554, make_shared<material>()));
+        lights->add(make_shared<flip_face>(make_shared<xz_rect>(123, 423, 147, 412, 554, make_shared<diffuse_light>(color(7, 7, 7)))));
         lights->add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<material>()));
 
         return lights;
@@ -455,7 +483,7 @@ public:
 
         hittable_list objects;
 
-        objects.add(make_shared<bvh_node>(boxes1, 0, 1));
+        objects.add(make_shared<linear_bvh>(boxes1, 0, 1, bvh_options));
 
         auto light_mat = make_shared<diffuse_light>(color(7, 7, 7));
         auto rect_light = make_shared<xz_rect>(123, 423, 147, 412, 554, light_mat);
@@ -491,11 +519,158 @@ public:
 
         objects.add(make_shared<translate>(
             make_shared<rotate_y>(
-                make_shared<bvh_node>(boxes2, 0.0, 1.0), 15),
+                make_shared<linear_bvh>(boxes2, 0.0, 1.0, bvh_options), 15),
             vec3(-100, 270, 395)));
 
         return objects;
     };
 };
 
+/**
+ * @brief 两级加速结构的测试场景：同一个 bunny 网格只构建一次 bvh，
+ * 以 1000 个实例的形式放置在地面上，每个实例有各自的变换和材质
+ */
+class instanced_meshes : public scene_generator
+{
+public:
+    instanced_meshes()
+    {
+        lookfrom = point3(0, 25, 55);
+        lookat = point3(0, 0, 0);
+        vfov = 40.0;
+        background_color = color(0.70, 0.80, 1.00);
+    }
+
+    virtual std::string output_filename() const override
+    {
+        return "instanced_meshes.ppm";
+    }
+
+    virtual hittable_list generate() const override
+    {
+        hittable_list world;
+
+        auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+        world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground));
+
+        // 底层加速结构只构建一次；bunny 原始尺寸约为 0.15，底部位于 y = 0.033
+        auto bunny = make_shared<mesh>("../../res/bunny.obj", make_shared<lambertian>(color(0.5)), 10.0f, bvh_layout::linear, bvh_options);
+
+        for (int i = 0; i < 40; i++)
+        {
+            for (int j = 0; j < 25; j++)
+            {
+                auto scale = random_double(0.7, 1.3);
+                auto position = point3(-39 + 2 * i, -0.33 * scale, -24 + 2 * j);
+
+                auto transform = affine_transform::translation(position) *
+                                 affine_transform::rotation(vec3(0, 1, 0), random_double(0, 360)) *
+                                 affine_transform::scaling(vec3(scale));
+
+                shared_ptr<material> mat;
+                if (random_double() < 0.2)
+                    mat = make_shared<metal>(color::random(0.5, 1), 0.1);
+                else
+                    mat = make_shared<lambertian>(color::random() * color::random());
+
+                world.add(make_shared<instance>(bunny, transform, mat));
+            }
+        }
+
+        return world;
+    }
+};
+
+/**
+ * @brief 大量光源的测试场景：一万个发光的小球分布在地面上方，大多数较暗，少数很亮；
+ * 用于比较不同的光源选择方式，只在基准测试中使用，没有加入 all_scenes
+ */
+class many_lights : public scene_generator
+{
+public:
+    many_lights()
+    {
+        lookfrom = point3(0, 6, 24);
+        lookat = point3(0, 1, 0);
+        vfov = 40.0;
+        background_color = color(0);
+    }
+
+    virtual std::string output_filename() const override
+    {
+        return "many_lights.ppm";
+    }
+
+    virtual shared_ptr<hittable_list> lights() const override
+    {
+        auto lights = make_shared<hittable_list>();
+        add_emitters(*lights);
+
+        return lights;
+    }
+
+    virtual hittable_list generate() const override
+    {
+        hittable_list world;
+
+        auto ground = make_shared<lambertian>(color(0.5));
+        world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground));
+
+        world.add(make_shared<sphere>(point3(-4, 1.5, 0), 1.5, make_shared<lambertian>(color(0.4, 0.2, 0.1))));
+        world.add(make_shared<sphere>(point3(0, 1.5, 0), 1.5, make_shared<dielectric>(1.5)));
+        world.add(make_shared<sphere>(point3(4, 1.5, 0), 1.5, make_shared<metal>(color(0.7, 0.6, 0.5), 0.05)));
+
+        add_emitters(world);
+
+        return world;
+    }
+
+    static constexpr int emitter_grid = 100; // 每行的光源数量，共 emitter_grid * emitter_grid 个
+
+private:
+    /**
+     * @brief 生成所有发光小球；使用固定种子的随机数，generate() 和 lights() 得到相同的光源
+     */
+    static void add_emitters(hittable_list &list)
+    {
+        counter_rng rng;
+        rng.seed(0, 0);
+
+        for (int i = 0; i < emitter_grid; i++)
+        {
+            for (int j = 0; j < emitter_grid; j++)
+            {
+                auto x = -20 + 40 * (i + rng.next_double()) / emitter_grid;
+                auto z = -20 + 40 * (j + rng.next_double()) / emitter_grid;
+                auto y = 0.1 + 4 * rng.next_double();
+
+                auto tint = color(rng.next_double(), rng.next_double(), rng.next_double()) + color(0.2);
+                auto intensity = rng.next_double() < 0.01 ? 200.0 : 5.0 + 10 * rng.next_double();
+
+                list.add(make_shared<sphere>(point3(x, y, z), 0.04, make_shared<diffuse_light>(intensity * tint)));
+            }
+        }
+    }
+};
+
+/**
+ * @brief 所有场景，下标即主程序中选择场景时使用的编号
+ */
+inline std::vector<shared_ptr<scene_generator>> all_scenes()
+{
+    std::vector<shared_ptr<scene_generator>> scenes;
+    scenes.push_back(make_shared<random_scene>());              // 0
+    scenes.push_back(make_shared<two_spheres>());               // 1
+    scenes.push_back(make_shared<two_perlin_spheres>());        // 2
+    scenes.push_back(make_shared<earth>());                     // 3
+    scenes.push_back(make_shared<simple_light>());              // 4
+    scenes.push_back(make_shared<cornell_box>());               // 5
+    scenes.push_back(make_shared<cornell_smoke>());             // 6
+    scenes.push_back(make_shared<the_next_week_final_scene>()); // 7
+    scenes.push_back(make_shared<test_scene>());                // 8
+    scenes.push_back(make_shared<instanced_meshes>());          // 9
+
+    return scenes;
+}
+
 #endif
@@ -4,6 +4,7 @@
 #include "hittable.h"
 #include "vec3.h"
 #include "onb.h"
+#include "material.h"
 
 class sphere : public hittable
 {
@@ -12,7 +13,25 @@ public:
     sphere(point3 cen, double r, shared_ptr<material> mat) : center(cen), radius(r), mat(mat){};
 
     virtual bool hit(
-        const ray &r, double t_min, double t_max, hit_record &rec) const override;
+        const ray &r, double t_min, double t_max, hit_record &rec) const override
+    {
+        return intersect(r, t_min, t_max, rec);
+    }
+
+    /**
+     * @brief 求交的实现，非虚函数，强制内联到调用它的遍历循环中
+     */
+    RTW_FORCE_INLINE bool intersect(const ray &r, double t_min, double t_max, hit_record &rec) const;
+
+    virtual bool hit_any(const ray &r, double t_min, double t_max) const override
+    {
+        return occluded(r, t_min, t_max);
+    }
+
+    /**
+     * @brief hit_any 的实现，与 intersect 相同，非虚函数，强制内联到调用它的遍历循环中
+     */
+    RTW_FORCE_INLINE bool occluded(const ray &r, double t_min, double t_max) const;
 
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override;
 
@@ -20,13 +39,18 @@ public:
 
     virtual vec3 random(const vec3 &origin) const override;
 
+    virtual double power() const override
+    {
+        return luminance(mat->average_emission()) * 4 * pi * radius * radius;
+    }
+
 public:
     point3 center;
     double radius;
     shared_ptr<material> mat;
 
 private:
-    static void get_sphere_uv(const point3 &p, double &u, double &v)
+    static void get_sphere_uv(const point3 &p, real &u, real &v)
     {
         auto theta = acos(-p.y());
         auto phi = atan2(-p.z(), p.x()) + pi;
@@ -36,7 +60,7 @@ private:
     }
 };
 
-bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
+inline bool sphere::intersect(const ray &r, double t_min, double t_max, hit_record &rec) const
 {
     vec3 oc = r.origin() - center;
     auto a = r.direction().length_squared();
@@ -59,7 +83,7 @@ bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) cons
 
     rec.t = root;
     rec.p = r.at(rec.t);
-    rec.mat = mat;
+    rec.mat = mat.get();
 
     vec3 outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
@@ -69,6 +93,26 @@ bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) cons
     return true;
 }
 
+inline bool sphere::occluded(const ray &r, double t_min, double t_max) const
+{
+    vec3 oc = r.origin() - center;
+    auto a = r.direction().length_squared();
+    auto half_b = dot(oc, r.direction());
+    auto c = oc.length_squared() - radius * radius;
+
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant < 0)
+        return false;
+    auto sqrtd = sqrt(discriminant);
+
+    auto root = (-half_b - sqrtd) / a;
+    if (root >= t_min && root <= t_max)
+        return true;
+
+    root = (-half_b + sqrtd) / a;
+    return root >= t_min && root <= t_max;
+}
+
 bool sphere::bounding_box(double time0, double time1, aabb &output_box) const
 {
     output_box = aabb(center - vec3(radius, radius, radius),
@@ -79,8 +123,7 @@ bool sphere::bounding_box(double time0, double time1, aabb &output_box) const
 
 double sphere::pdf_value(const point3 &o, const vec3 &v) const
 {
-    hit_record rec;
-    if (!this->hit(ray(o, v), 0.001, infinity, rec))
+    if (!any_hit_query(*this, ray(o, v), 0.001, infinity))
         return 0;
 
     auto cos_theta_max = sqrt(1 - radius * radius / (center - o).length_squared());
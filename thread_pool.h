@@ -0,0 +1,254 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 常驻线程池；每个工作线程拥有一个自己的任务队列，自己的队列为空时
+ * 会从其它线程的队列头部窃取任务，从而让耗时不均的任务也能把所有核心填满
+ */
+class thread_pool
+{
+public:
+    /**
+     * @brief 任务函数，参数为执行该任务的工作线程下标
+     */
+    using task = std::function<void(int)>;
+
+    /**
+     * @param thread_count 工作线程数量，小于等于 0 时使用硬件线程数
+     */
+    explicit thread_pool(int thread_count = 0)
+    {
+        if (thread_count <= 0)
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+        for (int i = 0; i < thread_count; i++)
+            queues.push_back(std::make_unique<worker_queue>());
+
+        for (int i = 0; i < thread_count; i++)
+            workers.emplace_back([this, i]
+                                 { worker_loop(i); });
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    int size() const { return static_cast<int>(workers.size()); }
+
+    /**
+     * @brief 一组可以单独等待的任务，用于在任务中继续拆分子任务
+     */
+    class task_group
+    {
+        friend class thread_pool;
+        std::atomic<size_t> pending{0};
+    };
+
+    /**
+     * @brief 提交一个任务；在工作线程中提交时放入该线程自己的队列，
+     * 否则按轮询方式放入各个工作线程的队列
+     */
+    void submit(task t)
+    {
+        // 先登记计数再入队，保证任务被取走时计数不会变为负数
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            pending++;
+            queued++;
+        }
+
+        int index = current_pool == this ? current_index
+                                         : static_cast<int>(next_queue.fetch_add(1, std::memory_order_relaxed) % size());
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(t));
+        }
+        work_available.notify_one();
+    }
+
+    /**
+     * @brief 提交一个属于 group 的任务
+     */
+    void submit(task_group &group, task t)
+    {
+        group.pending++;
+        submit([this, &group, t = std::move(t)](int index)
+               {
+                   t(index);
+                   if (--group.pending == 0)
+                   {
+                       std::lock_guard<std::mutex> lock(state_mutex);
+                       all_done.notify_all();
+                   } });
+    }
+
+    /**
+     * @brief 等待 group 中的任务全部完成；在工作线程中调用时，等待期间会继续执行
+     * 队列中的其它任务，因此任务内部可以安全地等待自己拆分出的子任务
+     */
+    void wait(task_group &group)
+    {
+        if (current_pool == this)
+        {
+            task t;
+            while (group.pending > 0)
+            {
+                if (try_pop(current_index, t))
+                {
+                    execute(current_index, t);
+                    t = nullptr;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+        all_done.wait(lock, [&group]
+                      { return group.pending == 0; });
+    }
+
+    /**
+     * @brief 将 [begin, end) 切分为大小为 grain 的区间并行执行 fn(区间起点, 区间终点)，
+     * 返回时所有区间都已执行完毕
+     */
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F &&fn)
+    {
+        task_group group;
+        for (size_t b = begin; b < end; b += grain)
+        {
+            size_t e = std::min(b + grain, end);
+            submit(group, [&fn, b, e](int)
+                   { fn(b, e); });
+        }
+
+        wait(group);
+    }
+
+    /**
+     * @brief 阻塞调用线程，直到所有已提交的任务执行完毕
+     */
+    void wait_idle()
+    {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        all_done.wait(lock, [this]
+                      { return pending == 0; });
+    }
+
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    // 当前线程所属的线程池及其在线程池中的下标，不是工作线程时为 nullptr
+    static inline thread_local thread_pool *current_pool = nullptr;
+    static inline thread_local int current_index = -1;
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue{0};
+
+    std::mutex state_mutex;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    size_t pending = 0;               // 已提交但尚未执行完毕的任务数量
+    std::atomic<size_t> queued{0};    // 仍在队列中、尚未被任何线程取走的任务数量
+    bool stopping = false;
+
+    /**
+     * @brief 先从自己队列的尾部取任务，取不到时依次从其它队列的头部窃取
+     */
+    bool try_pop(int index, task &out)
+    {
+        {
+            auto &own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                out = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued--;
+                return true;
+            }
+        }
+
+        for (int i = 1; i < size(); i++)
+        {
+            auto &victim = *queues[(index + i) % size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                out = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void execute(int index, task &t)
+    {
+        t(index);
+
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (--pending == 0)
+            all_done.notify_all();
+    }
+
+    void worker_loop(int index)
+    {
+        current_pool = this;
+        current_index = index;
+
+        task t;
+        while (true)
+        {
+            if (try_pop(index, t))
+            {
+                execute(index, t);
+                t = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(state_mutex);
+            if (stopping)
+                return;
+
+            work_available.wait(lock, [this]
+                                { return stopping || queued > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef TILE_WRITER_H
+#define TILE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rtweekend.h"
+
+#include "image_io.h"
+
+/**
+ * @brief 逐个 tile 写入图像文件的接口，用于流式输出：渲染器每完成一个 tile 就把它交给 tile_writer，
+ * 不需要在内存中保留整幅画面。文件的大小和每个 tile 的位置在 open 时就已经确定，
+ * tile 可以按任意顺序写入，每次写入都直接定位到该 tile 在文件中的位置
+ *
+ * 坐标以图像左上角为原点，y 向下；tile 的左上角总是 tile_size 的整数倍
+ */
+class tile_writer
+{
+public:
+    virtual ~tile_writer() {}
+
+    /**
+     * @brief 在渲染开始前创建文件
+     *
+     * @return 创建成功时返回 true
+     */
+    virtual bool open(int width, int height, int tile_size) = 0;
+
+    /**
+     * @brief 写入左上角为 (x0, y0) 的 tile，可以在多个线程中同时调用
+     *
+     * @param pixels 按从上到下、从左到右的顺序排列的 tile_width × tile_height 个像素（线性颜色，已经取过平均）
+     */
+    virtual void write_tile(int x0, int y0, int tile_width, int tile_height, const std::vector<color> &pixels) = 0;
+
+    /**
+     * @brief 所有 tile 写入后关闭文件
+     *
+     * @return 所有写入都成功时返回 true
+     */
+    virtual bool close() = 0;
+
+public:
+    std::string filename;
+};
+
+/**
+ * @brief 逐个 tile 写入二进制 PPM（P6）文件；P6 按行存储，tile 的每一行分别定位到它在文件中的位置
+ */
+class ppm_tile_writer : public tile_writer
+{
+public:
+    explicit ppm_tile_writer(const std::string &filename) { this->filename = filename; }
+
+    virtual bool open(int width, int height, int tile_size) override
+    {
+        image_width = width;
+
+        file.open(filename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file << "P6\n"
+             << width << ' ' << height << "\n255\n";
+        header_size = static_cast<uint64_t>(file.tellp());
+
+        // 先把文件扩展到最终的大小，之后每个 tile 都写在已经存在的位置上
+        file.seekp(header_size + static_cast<uint64_t>(width) * height * 3 - 1);
+        file.put(0);
+
+        return static_cast<bool>(file);
+    }
+
+    virtual void write_tile(int x0, int y0, int tile_width, int tile_height, const std::vector<color> &pixels) override
+    {
+        std::vector<uint8_t> bytes(pixels.size() * 3);
+        for (size_t i = 0; i < pixels.size(); i++)
+            encode_ppm_pixel(pixels[i], &bytes[i * 3]);
+
+        std::lock_guard<std::mutex> lock(file_mutex);
+        for (int y = 0; y < tile_height; y++)
+        {
+            file.seekp(header_size + (static_cast<uint64_t>(y0 + y) * image_width + x0) * 3);
+            file.write(reinterpret_cast<const char *>(&bytes[static_cast<size_t>(y) * tile_width * 3]), tile_width * 3);
+        }
+    }
+
+    virtual bool close() override
+    {
+        file.close();
+        return !file.fail();
+    }
+
+private:
+    std::fstream file;
+    std::mutex file_mutex;
+    int image_width = 0;
+    uint64_t header_size = 0;
+};
+
+/**
+ * @brief 逐个 tile 写入按 tile 存储（而非逐行存储）的不压缩 OpenEXR 文件，每个 tile 是一个数据块；
+ * 不压缩时每个数据块的大小只由 tile 的尺寸决定，因此 open 时就可以写好完整的偏移量表
+ *
+ * 每个数据块依次为 tile 的 x、y 编号，层级编号（0, 0），数据长度，以及 tile 的每一行中
+ * 按通道名称排序（B、G、R）的各通道的像素
+ */
+class exr_tile_writer : public tile_writer
+{
+public:
+    explicit exr_tile_writer(const std::string &filename, exr_pixel_type type = exr_pixel_type::half)
+        : type(type)
+    {
+        this->filename = filename;
+    }
+
+    virtual bool open(int width, int height, int tile_size) override
+    {
+        this->tile_size = tile_size;
+        tiles_x = (width + tile_size - 1) / tile_size;
+        int tiles_y = (height + tile_size - 1) / tile_size;
+
+        std::vector<char> header;
+        append_exr_header(header, width, height, type, tile_size);
+
+        // 偏移量表按 tile 的行优先顺序排列，数据块也按这个顺序存放；边缘的 tile 被图像边界截断
+        int channel_size = type == exr_pixel_type::half ? 2 : 4;
+        uint64_t offset = header.size() + static_cast<uint64_t>(tiles_x) * tiles_y * sizeof(uint64_t);
+        offsets.clear();
+        for (int ty = 0; ty < tiles_y; ty++)
+        {
+            for (int tx = 0; tx < tiles_x; tx++)
+            {
+                uint64_t w = std::min(tile_size, width - tx * tile_size);
+                uint64_t h = std::min(tile_size, height - ty * tile_size);
+
+                offsets.push_back(offset);
+                auto bytes = reinterpret_cast<const char *>(&offset);
+                header.insert(header.end(), bytes, bytes + sizeof(offset));
+                offset += 20 + w * h * 3 * channel_size;
+            }
+        }
+
+        file.open(filename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(header.data(), header.size());
+        file.seekp(offset - 1);
+        file.put(0);
+
+        return static_cast<bool>(file);
+    }
+
+    virtual void write_tile(int x0, int y0, int tile_width, int tile_height, const std::vector<color> &pixels) override
+    {
+        int channel_size = type == exr_pixel_type::half ? 2 : 4;
+        int32_t data_size = tile_width * tile_height * 3 * channel_size;
+        int32_t tile_x = x0 / tile_size, tile_y = y0 / tile_size, level = 0;
+
+        std::vector<char> chunk(20 + static_cast<size_t>(data_size));
+        std::memcpy(&chunk[0], &tile_x, 4);
+        std::memcpy(&chunk[4], &tile_y, 4);
+        std::memcpy(&chunk[8], &level, 4);
+        std::memcpy(&chunk[12], &level, 4);
+        std::memcpy(&chunk[16], &data_size, 4);
+
+        size_t position = 20;
+        for (int y = 0; y < tile_height; y++)
+        {
+            for (int c : exr_channel_index)
+            {
+                for (int x = 0; x < tile_width; x++)
+                    position += encode_exr_value(pixels[y * tile_width + x][c], type, &chunk[position]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file.seekp(offsets[static_cast<size_t>(tile_y) * tiles_x + tile_x]);
+        file.write(chunk.data(), chunk.size());
+    }
+
+    virtual bool close() override
+    {
+        file.close();
+        return !file.fail();
+    }
+
+private:
+    exr_pixel_type type;
+    std::fstream file;
+    std::mutex file_mutex;
+    int tile_size = 0;
+    int tiles_x = 0;
+    std::vector<uint64_t> offsets; // 每个数据块在文件中的位置
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cmath>
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+/**
+ * @brief 仿射变换，以 3x4 矩阵表示：前三列为线性部分，最后一列为平移
+ */
+class affine_transform
+{
+public:
+    /**
+     * @brief 单位变换
+     */
+    affine_transform()
+    {
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++)
+                m[i][j] = i == j ? 1.0 : 0.0;
+    }
+
+    static affine_transform translation(const vec3 &offset)
+    {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            t.m[i][3] = offset[i];
+        return t;
+    }
+
+    static affine_transform scaling(const vec3 &scale)
+    {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            t.m[i][i] = scale[i];
+        return t;
+    }
+
+    /**
+     * @brief 绕经过原点的 axis 轴旋转 angle 度（右手系）
+     */
+    static affine_transform rotation(const vec3 &axis, double angle)
+    {
+        auto a = unit_vector(axis);
+        auto radians = degrees_to_radians(angle);
+        auto c = cos(radians);
+        auto s = sin(radians);
+        auto k = 1.0 - c;
+
+        affine_transform t;
+        t.m[0][0] = c + a.x() * a.x() * k;
+        t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+        t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+        t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+        t.m[1][1] = c + a.y() * a.y() * k;
+        t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+        t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+        t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+        t.m[2][2] = c + a.z() * a.z() * k;
+        return t;
+    }
+
+    /**
+     * @brief 变换一个点（包括平移）
+     */
+    point3 point(const point3 &p) const
+    {
+        return point3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+                      m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+                      m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+    }
+
+    /**
+     * @brief 变换一个方向（不包括平移）
+     */
+    vec3 vector(const vec3 &v) const
+    {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                    m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                    m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    /**
+     * @brief 用线性部分的转置变换一个方向；对逆变换调用即可得到法线的变换结果（未归一化）
+     */
+    vec3 transposed_vector(const vec3 &v) const
+    {
+        return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+                    m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+                    m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+    }
+
+    /**
+     * @brief 变换后的包围盒，由原包围盒 8 个顶点变换后的包围盒得到
+     */
+    aabb box(const aabb &b) const
+    {
+        point3 min(infinity, infinity, infinity);
+        point3 max(-infinity, -infinity, -infinity);
+
+        for (int i = 0; i < 8; i++)
+        {
+            point3 corner((i & 1) ? b.max().x() : b.min().x(),
+                          (i & 2) ? b.max().y() : b.min().y(),
+                          (i & 4) ? b.max().z() : b.min().z());
+            auto p = point(corner);
+
+            for (int c = 0; c < 3; c++)
+            {
+                min[c] = fmin(min[c], p[c]);
+                max[c] = fmax(max[c], p[c]);
+            }
+        }
+
+        return aabb(min, max);
+    }
+
+    /**
+     * @brief 逆变换；线性部分不可逆时结果没有意义
+     */
+    affine_transform inverse() const
+    {
+        double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                     m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                     m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        double inv_det = 1.0 / det;
+
+        affine_transform t;
+        t.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+        t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+        t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+        t.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+        t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+        t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+        t.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+        t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+        t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+        // 逆变换的平移为 -A^-1 * b
+        auto offset = t.vector(vec3(m[0][3], m[1][3], m[2][3]));
+        for (int i = 0; i < 3; i++)
+            t.m[i][3] = -offset[i];
+
+        return t;
+    }
+
+    /**
+     * @brief 变换的复合，先应用 b 再应用 a
+     */
+    friend affine_transform operator*(const affine_transform &a, const affine_transform &b)
+    {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                t.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+                if (j == 3)
+                    t.m[i][j] += a.m[i][3];
+            }
+        }
+        return t;
+    }
+
+public:
+    double m[3][4];
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "hittable.h"
 #include "vec3.h"
+#include "material.h"
 
 struct vertex
 {
@@ -36,33 +37,80 @@ public:
         uv2 = v2.uv - v0.uv;
     }
 
-    virtual bool hit(const ray &ray, double t_min, double t_max, hit_record &rec) const override;
+    virtual bool hit(const ray &ray, double t_min, double t_max, hit_record &rec) const override
+    {
+        return intersect(ray, t_min, t_max, rec);
+    }
+
+    /**
+     * @brief 求交的实现，非虚函数，强制内联到调用它的遍历循环中
+     */
+    RTW_FORCE_INLINE bool intersect(const ray &ray, double t_min, double t_max, hit_record &rec) const;
+
+    virtual bool hit_any(const ray &ray, double t_min, double t_max) const override
+    {
+        return occluded(ray, t_min, t_max);
+    }
+
+    /**
+     * @brief hit_any 的实现，与 intersect 相同，非虚函数，强制内联到调用它的遍历循环中
+     */
+    RTW_FORCE_INLINE bool occluded(const ray &ray, double t_min, double t_max) const
+    {
+        float t, u, v;
+        return find_hit(ray, t_min, t_max, t, u, v);
+    }
 
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override;
 
     virtual double pdf_value(const point3 &origin, const vec3 &direction) const override;
 
     virtual vec3 random(const vec3 &origin) const override;
-};
 
-bool triangle::hit(const ray &ray, double t_min, double t_max, hit_record &rec) const
-{
-    auto s = ray.origin() - v0.position;
-    auto s1 = cross(ray.direction(), e2);
-    auto s2 = cross(s, e1);
+    virtual double power() const override
+    {
+        return luminance(mat->average_emission()) * 0.5 * cross(e1, e2).length();
+    }
 
-    auto invS1dE1 = 1.0f / dot(s1, e1);
+    virtual void emission_cone(vec3 &w, double &cos_theta_o, bool &two_sided) const override
+    {
+        w = unit_vector(cross(e1, e2));
+        cos_theta_o = 1;
+        two_sided = true;
+    }
 
-    float t = dot(s2, e2) * invS1dE1;
-    if (t < t_min || t > t_max)
-        return false;
+private:
+    /**
+     * @brief Möller–Trumbore 求交，击中时返回交点的 t 和重心坐标
+     */
+    RTW_FORCE_INLINE bool find_hit(const ray &ray, double t_min, double t_max, float &t, float &u, float &v) const
+    {
+        auto s = ray.origin() - v0.position;
+        auto s1 = cross(ray.direction(), e2);
+        auto s2 = cross(s, e1);
 
-    float u = dot(s1, s) * invS1dE1;
-    if (u < 0.0f || u > 1.0f)
-        return false;
+        auto invS1dE1 = 1.0f / dot(s1, e1);
+
+        t = dot(s2, e2) * invS1dE1;
+        if (t < t_min || t > t_max)
+            return false;
 
-    float v = dot(s2, ray.direction()) * invS1dE1;
-    if (v < 0.0f || u + v > 1.0f)
+        u = dot(s1, s) * invS1dE1;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        v = dot(s2, ray.direction()) * invS1dE1;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        return true;
+    }
+};
+
+inline bool triangle::intersect(const ray &ray, double t_min, double t_max, hit_record &rec) const
+{
+    float t, u, v;
+    if (!find_hit(ray, t_min, t_max, t, u, v))
         return false;
 
     auto uv = uv1 * u + uv2 * v + v0.uv;
@@ -72,7 +120,7 @@ bool triangle::hit(const ray &ray, double t_min, double t_max, hit_record &rec)
     rec.u = uv.x();
     rec.v = uv.y();
     rec.set_face_normal(ray, normal);
-    rec.mat = mat;
+    rec.mat = mat.get();
     rec.p = ray.at(t);
 
     return true;
@@ -109,15 +157,17 @@ bool triangle::bounding_box(double time0, double time1, aabb &output_box) const
 
 double triangle::pdf_value(const point3 &origin, const vec3 &direction) const
 {
-    hit_record rec;
-    if (!hit(ray(origin, direction), 0.001, infinity, rec))
+    if (!any_hit_query(*this, ray(origin, direction), 0.001, infinity))
     {
         return 0;
     }
 
-    auto area = 0.5f * cross(e1, e2).length();
-    auto distance_squared = rec.t * rec.t * direction.length_squared();
-    auto cosine = fabs(dot(direction, rec.normal) / direction.length());
+    // 交点的 t 和夹角由三角形所在平面求出；面积采样对应的是几何法线，而不是插值得到的着色法线
+    auto n = cross(e1, e2);
+    auto t = dot(v0.position - origin, n) / dot(direction, n);
+    auto area = 0.5f * n.length();
+    auto distance_squared = t * t * direction.length_squared();
+    auto cosine = fabs(dot(direction, n) / (direction.length() * n.length()));
 
     return distance_squared / (cosine * area);
 }
@@ -0,0 +1,229 @@
+#ifndef TRIANGLE_PACKET_H
+#define TRIANGLE_PACKET_H
+
+#include <cstdint>
+#include <limits>
+
+#if defined(__AVX__)
+#define TRIANGLE_PACKET_USE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRIANGLE_PACKET_USE_SSE
+#include <immintrin.h>
+#endif
+
+#include "rtweekend.h"
+
+// 每个三角形包中的三角形数量；支持 AVX 时为 8，否则为 4
+#ifdef TRIANGLE_PACKET_USE_AVX
+constexpr int triangle_packet_width = 8;
+#else
+constexpr int triangle_packet_width = 4;
+#endif
+
+/**
+ * @brief 按分量分开存放（SoA）的一组三角形，用于一次 SIMD 运算与 W 个三角形求交；
+ * 只保存求交需要的顶点 v0 和两条边，数量不足 W 时剩余的通道为退化三角形，不会被击中
+ */
+template <int W>
+struct alignas(32) triangle_packet
+{
+    float v0x[W], v0y[W], v0z[W];
+    float e1x[W], e1y[W], e1z[W];
+    float e2x[W], e2y[W], e2z[W];
+    uint32_t index[W]; // 三角形在网格中的序号
+
+    /**
+     * @brief 设置第 lane 个通道的三角形
+     */
+    void set(int lane, uint32_t triangle_index, const point3 &p0, const point3 &p1, const point3 &p2)
+    {
+        auto e1 = p1 - p0;
+        auto e2 = p2 - p0;
+
+        v0x[lane] = static_cast<float>(p0.x());
+        v0y[lane] = static_cast<float>(p0.y());
+        v0z[lane] = static_cast<float>(p0.z());
+        e1x[lane] = static_cast<float>(e1.x());
+        e1y[lane] = static_cast<float>(e1.y());
+        e1z[lane] = static_cast<float>(e1.z());
+        e2x[lane] = static_cast<float>(e2.x());
+        e2y[lane] = static_cast<float>(e2.y());
+        e2z[lane] = static_cast<float>(e2.z());
+        index[lane] = triangle_index;
+    }
+
+    /**
+     * @brief 将第 lane 个通道设置为不会被击中的退化三角形
+     */
+    void clear(int lane)
+    {
+        v0x[lane] = v0y[lane] = v0z[lane] = 0.0f;
+        e1x[lane] = e1y[lane] = e1z[lane] = 0.0f;
+        e2x[lane] = e2y[lane] = e2z[lane] = 0.0f;
+        index[lane] = 0;
+    }
+};
+
+/**
+ * @brief 预先转换为 float 的射线
+ */
+struct triangle_packet_ray
+{
+    float origin[3];
+    float direction[3];
+};
+
+/**
+ * @brief 三角形包的求交结果，只包含最近交点的 t、重心坐标和三角形序号
+ */
+struct triangle_packet_hit
+{
+    float t;
+    float u;
+    float v;
+    uint32_t index;
+};
+
+/**
+ * @brief 用 Möller–Trumbore 算法一次与包中全部三角形求交，并保留 (t_min, t_max) 内最近的交点
+ *
+ * @return 有通道被击中时返回 true，并将 t_max 更新为最近交点的 t
+ */
+template <int W>
+inline bool intersect_packet(const triangle_packet<W> &packet, const triangle_packet_ray &r,
+                             float t_min, float &t_max, triangle_packet_hit &hit)
+{
+    alignas(32) float t[W], u[W], v[W];
+    unsigned mask = 0;
+    bool vectorized = false;
+
+#if defined(TRIANGLE_PACKET_USE_AVX)
+    if constexpr (W == 8)
+    {
+        const __m256 dx = _mm256_set1_ps(r.direction[0]), dy = _mm256_set1_ps(r.direction[1]), dz = _mm256_set1_ps(r.direction[2]);
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+        __m256 e1x = _mm256_load_ps(packet.e1x), e1y = _mm256_load_ps(packet.e1y), e1z = _mm256_load_ps(packet.e1z);
+        __m256 e2x = _mm256_load_ps(packet.e2x), e2y = _mm256_load_ps(packet.e2y), e2z = _mm256_load_ps(packet.e2z);
+        __m256 sx = _mm256_sub_ps(_mm256_set1_ps(r.origin[0]), _mm256_load_ps(packet.v0x));
+        __m256 sy = _mm256_sub_ps(_mm256_set1_ps(r.origin[1]), _mm256_load_ps(packet.v0y));
+        __m256 sz = _mm256_sub_ps(_mm256_set1_ps(r.origin[2]), _mm256_load_ps(packet.v0z));
+
+        // s1 = d x e2, s2 = s x e1
+        __m256 s1x = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        __m256 s1y = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        __m256 s1z = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        __m256 s2x = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+        __m256 s2y = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+        __m256 s2z = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+
+        __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s1x, e1x), _mm256_mul_ps(s1y, e1y)), _mm256_mul_ps(s1z, e1z));
+        __m256 inv_det = _mm256_div_ps(one, det);
+
+        __m256 tv = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s2x, e2x), _mm256_mul_ps(s2y, e2y)), _mm256_mul_ps(s2z, e2z)), inv_det);
+        __m256 uv = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s1x, sx), _mm256_mul_ps(s1y, sy)), _mm256_mul_ps(s1z, sz)), inv_det);
+        __m256 vv = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s2x, dx), _mm256_mul_ps(s2y, dy)), _mm256_mul_ps(s2z, dz)), inv_det);
+
+        __m256 valid = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(tv, _mm256_set1_ps(t_min), _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(tv, _mm256_set1_ps(t_max), _CMP_LE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(uv, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(vv, zero, _CMP_GE_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(uv, vv), one, _CMP_LE_OQ));
+
+        mask = static_cast<unsigned>(_mm256_movemask_ps(valid));
+        _mm256_store_ps(t, tv);
+        _mm256_store_ps(u, uv);
+        _mm256_store_ps(v, vv);
+        vectorized = true;
+    }
+#endif
+
+#if defined(TRIANGLE_PACKET_USE_SSE) || defined(TRIANGLE_PACKET_USE_AVX)
+    if constexpr (W == 4)
+    {
+        const __m128 dx = _mm_set1_ps(r.direction[0]), dy = _mm_set1_ps(r.direction[1]), dz = _mm_set1_ps(r.direction[2]);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+        __m128 e1x = _mm_load_ps(packet.e1x), e1y = _mm_load_ps(packet.e1y), e1z = _mm_load_ps(packet.e1z);
+        __m128 e2x = _mm_load_ps(packet.e2x), e2y = _mm_load_ps(packet.e2y), e2z = _mm_load_ps(packet.e2z);
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(r.origin[0]), _mm_load_ps(packet.v0x));
+        __m128 sy = _mm_sub_ps(_mm_set1_ps(r.origin[1]), _mm_load_ps(packet.v0y));
+        __m128 sz = _mm_sub_ps(_mm_set1_ps(r.origin[2]), _mm_load_ps(packet.v0z));
+
+        // s1 = d x e2, s2 = s x e1
+        __m128 s1x = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 s1y = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 s1z = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 s2x = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 s2y = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 s2z = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s1x, e1x), _mm_mul_ps(s1y, e1y)), _mm_mul_ps(s1z, e1z));
+        __m128 inv_det = _mm_div_ps(one, det);
+
+        __m128 tv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s2x, e2x), _mm_mul_ps(s2y, e2y)), _mm_mul_ps(s2z, e2z)), inv_det);
+        __m128 uv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s1x, sx), _mm_mul_ps(s1y, sy)), _mm_mul_ps(s1z, sz)), inv_det);
+        __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s2x, dx), _mm_mul_ps(s2y, dy)), _mm_mul_ps(s2z, dz)), inv_det);
+
+        __m128 valid = _mm_cmpneq_ps(det, zero);
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(tv, _mm_set1_ps(t_min)));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(tv, _mm_set1_ps(t_max)));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(uv, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uv, vv), one));
+
+        mask = static_cast<unsigned>(_mm_movemask_ps(valid));
+        _mm_store_ps(t, tv);
+        _mm_store_ps(u, uv);
+        _mm_store_ps(v, vv);
+        vectorized = true;
+    }
+#endif
+
+    if (!vectorized)
+    {
+        for (int i = 0; i < W; i++)
+        {
+            float sx = r.origin[0] - packet.v0x[i], sy = r.origin[1] - packet.v0y[i], sz = r.origin[2] - packet.v0z[i];
+
+            float s1x = r.direction[1] * packet.e2z[i] - r.direction[2] * packet.e2y[i];
+            float s1y = r.direction[2] * packet.e2x[i] - r.direction[0] * packet.e2z[i];
+            float s1z = r.direction[0] * packet.e2y[i] - r.direction[1] * packet.e2x[i];
+            float s2x = sy * packet.e1z[i] - sz * packet.e1y[i];
+            float s2y = sz * packet.e1x[i] - sx * packet.e1z[i];
+            float s2z = sx * packet.e1y[i] - sy * packet.e1x[i];
+
+            float det = s1x * packet.e1x[i] + s1y * packet.e1y[i] + s1z * packet.e1z[i];
+            float inv_det = 1.0f / det;
+
+            t[i] = (s2x * packet.e2x[i] + s2y * packet.e2y[i] + s2z * packet.e2z[i]) * inv_det;
+            u[i] = (s1x * sx + s1y * sy + s1z * sz) * inv_det;
+            v[i] = (s2x * r.direction[0] + s2y * r.direction[1] + s2z * r.direction[2]) * inv_det;
+
+            bool valid = det != 0.0f && t[i] >= t_min && t[i] <= t_max && u[i] >= 0.0f && v[i] >= 0.0f && u[i] + v[i] <= 1.0f;
+            mask |= static_cast<unsigned>(valid) << i;
+        }
+    }
+
+    if (!mask)
+        return false;
+
+    // 在被击中的通道中选出最近的交点
+    int best = -1;
+    for (int i = 0; i < W; i++)
+    {
+        if ((mask >> i) & 1u)
+        {
+            if (best < 0 || t[i] < t[best])
+                best = i;
+        }
+    }
+
+    t_max = t[best];
+    hit = {t[best], u[best], v[best], packet.index[best]};
+    return true;
+}
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIDE_BVH_USE_SSE
+#include <immintrin.h>
+#endif
+
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "linear_bvh.h"
+
+/**
+ * @brief 宽 bvh 的节点；一个节点最多有 N 个子节点，子节点的包围盒按分量分开存放（SoA），
+ * 这样一次 SIMD 运算就能完成 N 个包围盒同一个轴上的 slab 测试
+ *
+ * count[i] 为 0 时 child[i] 是子节点的下标，否则 child[i] 是叶节点第一个物体的下标，
+ * count[i] 为叶节点的物体数量
+ */
+template <int N>
+struct alignas(32) wide_bvh_node
+{
+    float min_x[N], min_y[N], min_z[N];
+    float max_x[N], max_y[N], max_z[N];
+    uint32_t child[N];
+    uint32_t count[N];
+    uint32_t child_count; // 有效子节点的数量
+};
+
+/**
+ * @brief 预先转换为 float 的射线数据，每条射线只计算一次
+ */
+struct wide_bvh_ray
+{
+    float origin[3];
+    float inv_dir[3];
+};
+
+/**
+ * @brief 射线与 N 个子节点包围盒的相交测试
+ *
+ * @param t_near 返回射线进入各个包围盒的 t
+ * @return 第 i 位为 1 表示与第 i 个子节点相交
+ */
+template <int N>
+inline unsigned intersect_children(const wide_bvh_node<N> &node, const wide_bvh_ray &r, float t_min, float t_max, float (&t_near)[N])
+{
+    unsigned mask = 0;
+
+#ifdef WIDE_BVH_USE_SSE
+    if constexpr (N % 4 == 0)
+    {
+        const __m128 ox = _mm_set1_ps(r.origin[0]), oy = _mm_set1_ps(r.origin[1]), oz = _mm_set1_ps(r.origin[2]);
+        const __m128 ix = _mm_set1_ps(r.inv_dir[0]), iy = _mm_set1_ps(r.inv_dir[1]), iz = _mm_set1_ps(r.inv_dir[2]);
+        const __m128 lo = _mm_set1_ps(t_min), hi = _mm_set1_ps(t_max);
+
+        for (int i = 0; i < N; i += 4)
+        {
+            __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x + i), ox), ix);
+            __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x + i), ox), ix);
+            __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y + i), oy), iy);
+            __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y + i), oy), iy);
+            __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z + i), oz), iz);
+            __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z + i), oz), iz);
+
+            __m128 t_enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                        _mm_max_ps(_mm_min_ps(t0z, t1z), lo));
+            __m128 t_exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                                       _mm_min_ps(_mm_max_ps(t0z, t1z), hi));
+
+            _mm_storeu_ps(t_near + i, t_enter);
+            mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(t_enter, t_exit))) << i;
+        }
+
+        return mask & ((1u << node.child_count) - 1);
+    }
+#endif
+
+    for (int i = 0; i < N; i++)
+    {
+        float t0x = (node.min_x[i] - r.origin[0]) * r.inv_dir[0];
+        float t1x = (node.max_x[i] - r.origin[0]) * r.inv_dir[0];
+        float t0y = (node.min_y[i] - r.origin[1]) * r.inv_dir[1];
+        float t1y = (node.max_y[i] - r.origin[1]) * r.inv_dir[1];
+        float t0z = (node.min_z[i] - r.origin[2]) * r.inv_dir[2];
+        float t1z = (node.max_z[i] - r.origin[2]) * r.inv_dir[2];
+
+        float t_enter = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), t_min));
+        float t_exit = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), t_max));
+
+        t_near[i] = t_enter;
+        mask |= static_cast<unsigned>(t_enter <= t_exit) << i;
+    }
+
+    return mask & ((1u << node.child_count) - 1);
+}
+
+/**
+ * @brief 宽 bvh；由二叉的构建结果合并而来，每次把表面积最大的内部子节点替换为它的
+ * 两个子节点，直到子节点数量达到 N；遍历时按进入距离由近到远访问相交的子节点
+ */
+template <int N>
+class wide_bvh_tree
+{
+    static_assert(N >= 2 && N <= 16, "wide_bvh_tree supports 2 to 16 children per node");
+
+public:
+    wide_bvh_tree() {}
+
+    explicit wide_bvh_tree(const bvh_build_node *root)
+    {
+        if (root)
+            collapse(*root, 1);
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    /**
+     * @brief 遍历 bvh，接口与 linear_bvh_tree::traverse 相同
+     */
+    template <typename F>
+    bool traverse(const ray &r, double t_min, double t_max, F &&intersect) const
+    {
+        return traverse_leaves(r, t_min, t_max, [&](uint32_t first, uint32_t count, double t_min, double &t_max) RTW_FORCE_INLINE
+                               {
+                                   bool hit_anything = false;
+                                   for (uint32_t i = first; i < first + count; i++)
+                                       hit_anything |= intersect(i, t_min, t_max);
+                                   return hit_anything; });
+    }
+
+    /**
+     * @brief 按叶节点遍历 bvh，接口与 linear_bvh_tree::traverse_leaves 相同，同样按指令集生成多个版本
+     */
+    template <typename F>
+    RTW_MULTIVERSION bool traverse_leaves(const ray &r, double t_min, double t_max, F &&intersect, bool any_hit = false) const
+    {
+        if (nodes.empty())
+            return false;
+
+        wide_bvh_ray wr;
+        for (int a = 0; a < 3; a++)
+        {
+            wr.origin[a] = static_cast<float>(r.origin()[a]);
+            wr.inv_dir[a] = static_cast<float>(1.0 / r.direction()[a]);
+        }
+
+        struct entry
+        {
+            uint32_t index;
+            uint32_t count; // 大于 0 时表示叶节点
+            float t_near;
+        };
+
+        entry stack[max_stack_size];
+        int stack_size = 0;
+        stack[stack_size++] = {0, 0, static_cast<float>(t_min)};
+        bool hit_anything = false;
+
+        while (stack_size > 0)
+        {
+            entry e = stack[--stack_size];
+
+            // 入栈之后 t_max 可能已经缩小，比当前最近交点更远的节点不需要再访问
+            if (e.t_near > t_max)
+                continue;
+
+            if (e.count > 0)
+            {
+                hit_anything |= intersect(e.index, e.count, t_min, t_max);
+                if (hit_anything && any_hit)
+                    return true;
+                continue;
+            }
+
+            const auto &node = nodes[e.index];
+
+            // 将 t_max 稍微放大，避免 float 误差导致漏掉边界上的交点
+            float t_near[N];
+            unsigned mask = intersect_children(node, wr, static_cast<float>(t_min),
+                                               static_cast<float>(t_max) * (1.0f + 4.0f * std::numeric_limits<float>::epsilon()), t_near);
+
+            // 按 t_near 从远到近入栈，使最近的子节点最先被访问
+            int first = stack_size;
+            while (mask)
+            {
+                int i = lowest_bit(mask);
+                mask &= mask - 1;
+
+                entry child = {node.child[i], node.count[i], t_near[i]};
+                int j = stack_size++;
+                while (j > first && stack[j - 1].t_near < child.t_near)
+                {
+                    stack[j] = stack[j - 1];
+                    j--;
+                }
+                stack[j] = child;
+            }
+        }
+
+        return hit_anything;
+    }
+
+public:
+    std::vector<wide_bvh_node<N>> nodes;
+
+    // 每个宽节点至少合并了一层二叉的内部节点，因此路径上的宽节点不超过 bvh_max_depth - 1 个；
+    // 访问每个宽节点时出栈一项、最多入栈 N 项
+    static constexpr int max_stack_size = (bvh_max_depth - 1) * (N - 1) + 1;
+
+private:
+    static int lowest_bit(unsigned mask)
+    {
+        int i = 0;
+        while (!(mask & 1u))
+        {
+            mask >>= 1;
+            i++;
+        }
+        return i;
+    }
+
+    uint32_t collapse(const bvh_build_node &build_node, int depth)
+    {
+        assert(depth < bvh_max_depth && "bvh_builder limits the tree depth");
+
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        // 根节点本身就是叶节点时，生成只有一个子节点的宽节点
+        std::vector<const bvh_build_node *> children;
+        if (build_node.is_leaf())
+        {
+            children.push_back(&build_node);
+        }
+        else
+        {
+            children.push_back(build_node.children[0].get());
+            children.push_back(build_node.children[1].get());
+        }
+
+        while (static_cast<int>(children.size()) < N)
+        {
+            int largest = -1;
+            double largest_area = -1;
+            for (int i = 0; i < static_cast<int>(children.size()); i++)
+            {
+                if (!children[i]->is_leaf() && children[i]->bounds.surface_area() > largest_area)
+                {
+                    largest = i;
+                    largest_area = children[i]->bounds.surface_area();
+                }
+            }
+
+            if (largest < 0)
+                break;
+
+            const bvh_build_node *expanded = children[largest];
+            children[largest] = expanded->children[0].get();
+            children.push_back(expanded->children[1].get());
+        }
+
+        wide_bvh_node<N> node = {};
+        node.child_count = static_cast<uint32_t>(children.size());
+
+        for (int i = 0; i < N; i++)
+        {
+            // 空的子节点使用一个不会被击中的包围盒
+            if (i >= static_cast<int>(children.size()))
+            {
+                node.min_x[i] = node.min_y[i] = node.min_z[i] = std::numeric_limits<float>::infinity();
+                node.max_x[i] = node.max_y[i] = node.max_z[i] = -std::numeric_limits<float>::infinity();
+                continue;
+            }
+
+            const auto &b = children[i]->bounds;
+            node.min_x[i] = conservative_float(b.min().x(), true);
+            node.min_y[i] = conservative_float(b.min().y(), true);
+            node.min_z[i] = conservative_float(b.min().z(), true);
+            node.max_x[i] = conservative_float(b.max().x(), false);
+            node.max_y[i] = conservative_float(b.max().y(), false);
+            node.max_z[i] = conservative_float(b.max().z(), false);
+        }
+
+        for (int i = 0; i < static_cast<int>(children.size()); i++)
+        {
+            if (children[i]->is_leaf())
+            {
+                node.child[i] = children[i]->first;
+                node.count[i] = children[i]->count;
+            }
+            else
+            {
+                node.child[i] = collapse(*children[i], depth + 1);
+                node.count[i] = 0;
+            }
+        }
+
+        nodes[index] = node;
+        return index;
+    }
+};
+
+template <int N>
+using wide_bvh = flat_bvh<wide_bvh_tree<N>>;
+
+#endif